@@ -4,8 +4,11 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <avr/wdt.h>
+#include <util/atomic.h>
 
+#ifndef frame_size
 #define frame_size 128
+#endif
 const uint8_t oe_pin = DDB2;
 const uint8_t a_pin = DDB1;
 const uint8_t b_pin = DDB0;
@@ -25,7 +28,41 @@ volatile union {
     .read = 0,
     .write = 1,
 };
+
+// Consecutive slots form groups (temporal grayscale bit-planes, see pi/source/temporal_grayscale.hpp).
+// The Pi's trailer byte marks the last slot of a group (wire bit 0 set, sent by legacy hosts) or a pending plane
+// (wire bit 0 cleared). A group becomes visible to the display (ready) when its last slot is received, and the display
+// loops over the current group until the next one is ready. A regular frame is a group of one slot.
+volatile uint8_t frame_group_end[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+volatile uint8_t frame_buffer_ready = 1;
+volatile uint8_t frame_buffer_first = 0;
 volatile uint8_t frame_tick = 0;
+
+// The Pi's trailer byte also sets the buffer depth (wire bits 2 to 4 inverted, 0 selects 7). A new group is received
+// only if fewer than buffer_depth slots are queued behind the displayed one, which bounds the delay between the
+// reception of a frame and its display (see set_buffer_depth in pi/source/led_panel.hpp).
+static uint8_t buffer_depth = 7;
+
+// Delta transfers (see send_deltas in pi/source/led_panel.hpp) only carry the blocks that changed since the previous
+// slot. A block is the 16 bytes of a panel's row block (ab), which are contiguous in the frame buffer. The transfer
+// starts with a bitmap of the changed blocks (bit block % 8 of byte block / 8, inverted on the wire), padded to an even
+// number of bytes so that the trailer keeps its request edge, followed by the changed blocks in order. The Pi's
+// trailer byte announces a delta transfer (wire bit 1 cleared). Timeouts, and 8 idle display periods after a frame,
+// fall back to full transfers.
+#define delta_block_size 16
+#define delta_blocks (frame_size / delta_block_size)
+#define delta_header_size ((delta_blocks + 15) / 16 * 2)
+static uint8_t delta_transfer = 0;
+static uint8_t delta_header[delta_header_size];
+static uint16_t transfer_size = frame_size;
+static uint16_t delta_offset = 0;
+
+// The Pi may request a checksum of the committed slot (wire bit 5 of the trailer cleared, legacy hosts never request
+// it) to verify that the bytes arrived intact (see verify in pi/source/led_panel.hpp). The firmware echoes the 16 bits
+// of the checksum, most significant first, on the acknowledge pin: each of the next 16 request edges sets the
+// acknowledge level to the next bit, and a 17th edge ends the echo. The checksum is a Fletcher-16 with 8-bit sums.
+static uint16_t echo_checksum = 0;
+
 ISR(TIMER0_COMPA_vect) {
     static uint8_t count = 0;
     static union {
@@ -68,8 +105,14 @@ ISR(TIMER0_COMPA_vect) {
         ++state.ab;
         if (state.ab == 0) {
             ++frame_tick;
-            if ((frame_buffer_index.read + 1) % 8 != frame_buffer_index.write) {
-                ++frame_buffer_index.read;
+            const uint8_t next = (frame_buffer_index.read + 1) % 8;
+            if (next != frame_buffer_ready) {
+                if (frame_group_end[frame_buffer_index.read]) {
+                    frame_buffer_first = next;
+                }
+                frame_buffer_index.read = next;
+            } else {
+                frame_buffer_index.read = frame_buffer_first;
             }
         }
     } else if (count == frame_size / 4 + 2) {
@@ -85,6 +128,87 @@ ISR(TIMER0_COMPA_vect) {
     ++count;
 }
 
+// commit_frame publishes the slot being written if group_end is not 0, along with the pending slots that precede it.
+static void commit_frame(uint8_t group_end) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        frame_group_end[frame_buffer_index.write] = group_end;
+        ++frame_buffer_index.write;
+        if (group_end) {
+            frame_buffer_ready = frame_buffer_index.write;
+        }
+    }
+}
+
+// slot_available returns 1 if the slot being written may receive a transfer.
+// The slots of the displayed group must not be overwritten, since the display may loop over them, and a new group
+// waits until fewer than buffer_depth slots are queued.
+static uint8_t slot_available(void) {
+    const uint8_t write = frame_buffer_index.write;
+    if (write == frame_buffer_first) {
+        return 0;
+    }
+    return !frame_group_end[(write + 7) % 8] || (write - frame_buffer_index.read + 7) % 8 < buffer_depth;
+}
+
+// next_delta_offset returns the frame buffer index of the first changed block at or after offset, or frame_size + 1.
+static uint16_t next_delta_offset(uint16_t offset) {
+    for (uint8_t block = (offset - 1) / delta_block_size; block < delta_blocks; ++block) {
+        if ((delta_header[block / 8] >> (block % 8)) & 1) {
+            return block * delta_block_size + 1;
+        }
+    }
+    return frame_size + 1;
+}
+
+// receive_brightness stores the brightness byte, and prepares the slot for a full or delta transfer.
+// A delta transfer patches a copy of the previous slot.
+static void receive_brightness(void) {
+    frame_buffer[frame_buffer_index.write][0] = PIND;
+    if (delta_transfer) {
+        const uint8_t previous = (frame_buffer_index.write + 7) % 8;
+        for (uint16_t index = 1; index < frame_size + 1; ++index) {
+            frame_buffer[frame_buffer_index.write][index] = frame_buffer[previous][index];
+        }
+        transfer_size = delta_header_size;
+    } else {
+        transfer_size = frame_size;
+    }
+}
+
+// slot_checksum computes the checksum of the slot being written (brightness and pixels, as received).
+static uint16_t slot_checksum(void) {
+    uint8_t sum = 0;
+    uint8_t sum_of_sums = 0;
+    for (uint16_t index = 0; index < frame_size + 1; ++index) {
+        sum += frame_buffer[frame_buffer_index.write][index];
+        sum_of_sums += sum;
+    }
+    return ((uint16_t)sum_of_sums << 8) | sum;
+}
+
+// receive_byte stores the byte number read_index (starting at 1 after the brightness) of a transfer.
+static void receive_byte(uint16_t read_index) {
+    if (!delta_transfer) {
+        frame_buffer[frame_buffer_index.write][read_index] = PIND;
+    } else if (read_index <= delta_header_size) {
+        delta_header[read_index - 1] = ~PIND;
+        if (read_index == delta_header_size) {
+            for (uint8_t block = 0; block < delta_blocks; ++block) {
+                if ((delta_header[block / 8] >> (block % 8)) & 1) {
+                    transfer_size += delta_block_size;
+                }
+            }
+            delta_offset = next_delta_offset(1);
+        }
+    } else {
+        frame_buffer[frame_buffer_index.write][delta_offset] = PIND;
+        ++delta_offset;
+        if ((delta_offset - 1) % delta_block_size == 0) {
+            delta_offset = next_delta_offset(delta_offset);
+        }
+    }
+}
+
 int main(void) {
     wdt_reset();
     wdt_disable();
@@ -125,60 +249,72 @@ int main(void) {
         switch (read_state) {
             case 0:
                 if ((PINC >> pi_request_pin) & 1) {
-                    const uint8_t read = frame_buffer_index.read;
-                    if (frame_buffer_index.write == read) {
+                    if (!slot_available()) {
                         read_state = 1;
                     } else {
-                        frame_buffer[frame_buffer_index.write][0] = PIND;
+                        receive_brightness();
                         PORTC |= (1 << pi_acknowledge_pin);
                         previous_frame_tick = frame_tick;
                         read_index = 1;
                         read_state = 2;
                     }
+                } else if (delta_transfer && (uint8_t)(frame_tick - previous_frame_tick) > 8) {
+                    delta_transfer = 0;
                 }
                 break;
-            case 1: {
-                const uint8_t read = frame_buffer_index.read;
-                if (frame_buffer_index.write != read) {
-                    frame_buffer[frame_buffer_index.write][0] = PIND;
+            case 1:
+                if (slot_available()) {
+                    receive_brightness();
                     PORTC |= (1 << pi_acknowledge_pin);
                     previous_frame_tick = frame_tick;
                     read_index = 1;
                     read_state = 2;
                 }
                 break;
-            }
             case 2:
                 if (((PINC >> pi_request_pin) & 1) != (read_index & 1)) {
-                    frame_buffer[frame_buffer_index.write][read_index] = PIND;
+                    receive_byte(read_index);
                     if (read_index & 1) {
                         PORTC &= ~(1 << pi_acknowledge_pin);
                     } else {
                         PORTC |= (1 << pi_acknowledge_pin);
                     }
-                    if (read_index < frame_size) {
+                    if (read_index < transfer_size) {
                         previous_frame_tick = frame_tick;
                         ++read_index;
                     } else {
-                        ++frame_buffer_index.write;
                         read_state = 3;
                     }
                 } else {
                     const uint8_t ellapsed = frame_tick - previous_frame_tick;
                     if (ellapsed > 8) {
                         PORTC &= ~(1 << pi_acknowledge_pin);
+                        delta_transfer = 0;
                         read_state = 0;
                     }
                 }
                 break;
             case 3:
                 if (((PINC >> pi_request_pin) & 1) == 0) {
+                    const uint8_t trailer = PIND;
+                    const uint8_t echo = ((trailer >> 5) & 1) == 0;
+                    if (echo) {
+                        echo_checksum = slot_checksum();
+                    }
+                    commit_frame(trailer & 1);
+                    delta_transfer = ((trailer >> 1) & 1) == 0;
+                    const uint8_t depth = (~trailer >> 2) & 7;
+                    buffer_depth = depth == 0 ? 7 : depth;
+                    previous_frame_tick = frame_tick;
                     PORTC &= ~(1 << pi_acknowledge_pin);
-                    read_state = 0;
+                    read_index = 0;
+                    read_state = echo ? 5 : 0;
                 } else {
                     const uint8_t ellapsed = frame_tick - previous_frame_tick;
                     if (ellapsed > 8) {
+                        commit_frame(1);
                         PORTC &= ~(1 << pi_acknowledge_pin);
+                        delta_transfer = 0;
                         read_state = 4;
                     }
                 }
@@ -188,6 +324,28 @@ int main(void) {
                     read_state = 0;
                 }
                 break;
+            case 5:
+                // read_index counts the echo edges (the request rises on even edges)
+                if (((PINC >> pi_request_pin) & 1) != (read_index & 1)) {
+                    if (read_index < 16 && ((echo_checksum >> (15 - read_index)) & 1)) {
+                        PORTC |= (1 << pi_acknowledge_pin);
+                    } else {
+                        PORTC &= ~(1 << pi_acknowledge_pin);
+                    }
+                    if (read_index < 16) {
+                        previous_frame_tick = frame_tick;
+                        ++read_index;
+                    } else {
+                        read_state = 4;
+                    }
+                } else {
+                    const uint8_t ellapsed = frame_tick - previous_frame_tick;
+                    if (ellapsed > 8) {
+                        PORTC &= ~(1 << pi_acknowledge_pin);
+                        read_state = 4;
+                    }
+                }
+                break;
             default:
                 break;
         }
@@ -0,0 +1,9 @@
+// Stand-in for the AVR interrupt macros, used by the host build of the firmware (see avr_host.h).
+// The timer interrupt is called by avr_host_interrupt, and sei signals that the firmware has started its main loop.
+
+#pragma once
+
+#include "../avr_host.h"
+
+#define ISR(vector) void vector(void)
+#define sei() avr_host_started()
@@ -0,0 +1,18 @@
+// Stand-in for the AVR I/O registers, used by the host build of the firmware (see avr_host.h).
+// The pins connected to the Raspberry Pi are driven by the host harness. The other registers are plain variables.
+
+#pragma once
+
+#include "../avr_host.h"
+#include <stdint.h>
+
+#define PIND (avr_host_pind())
+#define PINC (avr_host_pinc())
+extern volatile _Atomic uint8_t PORTC;
+extern volatile uint8_t PORTB, PORTD, DDRB, DDRC, DDRD, SPDR, SPCR, UCSR0B, OCR0A, TCCR0A, TCCR0B, TIMSK0;
+
+enum { DDB0 = 0, DDB1 = 1, DDB2 = 2, DDB3 = 3, DDB5 = 5 };
+enum { DDC0 = 0, DDC1 = 1, DDC2 = 2 };
+enum { TXEN0 = 3, RXEN0 = 4 };
+enum { CS00 = 0, WGM01 = 1, OCIE0A = 1 };
+enum { SPR0 = 0, MSTR = 4, SPE = 6 };
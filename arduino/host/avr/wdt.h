@@ -0,0 +1,6 @@
+// Stand-in for the AVR watchdog macros, used by the host build of the firmware (see avr_host.h).
+
+#pragma once
+
+#define wdt_reset()
+#define wdt_disable()
@@ -0,0 +1,120 @@
+#include "avr_host.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#ifndef frame_size
+#define frame_size 128
+#endif
+
+// stand-in registers (see avr/io.h)
+volatile _Atomic uint8_t PORTC;
+volatile uint8_t PORTB, PORTD, DDRB, DDRC, DDRD, SPDR, SPCR, UCSR0B, OCR0A, TCCR0A, TCCR0B, TIMSK0;
+
+// firmware symbols (see arduino.c)
+int firmware_main(void);
+void TIMER0_COMPA_vect(void);
+extern volatile uint8_t frame_buffer[8][frame_size + 1];
+extern volatile union {
+    struct {
+        uint8_t read : 3;
+        uint8_t write : 3;
+        uint8_t reserved : 2;
+    };
+    uint8_t value;
+} frame_buffer_index;
+
+static _Atomic uint8_t pind;
+static _Atomic uint8_t pinc;
+static atomic_bool started;
+static atomic_bool stopped;
+static uint8_t yield;
+static pthread_t thread;
+static pthread_mutex_t interrupts = PTHREAD_MUTEX_INITIALIZER;
+
+static void* run(void* argument) {
+    (void)argument;
+    firmware_main();
+    return NULL;
+}
+
+void avr_host_start(void) {
+    // busy loops must yield if the firmware, the interrupt and the harness share fewer than three cores
+    yield = sysconf(_SC_NPROCESSORS_ONLN) < 3;
+    atomic_store(&started, 0);
+    atomic_store(&stopped, 0);
+    pthread_create(&thread, NULL, run, NULL);
+    while (!atomic_load(&started)) {
+        sched_yield();
+    }
+}
+
+void avr_host_stop(void) {
+    atomic_store(&stopped, 1);
+    pthread_join(thread, NULL);
+}
+
+void avr_host_interrupt(void) {
+    pthread_mutex_lock(&interrupts);
+    TIMER0_COMPA_vect();
+    pthread_mutex_unlock(&interrupts);
+}
+
+void avr_host_set_pins(uint8_t new_pind, uint8_t new_pinc) {
+    atomic_store(&pind, new_pind);
+    atomic_store(&pinc, new_pinc);
+}
+
+uint8_t avr_host_portc(void) {
+    return atomic_load(&PORTC);
+}
+
+uint16_t avr_host_frame_size(void) {
+    return frame_size;
+}
+
+uint8_t avr_host_committed_slot(void) {
+    pthread_mutex_lock(&interrupts);
+    const uint8_t result = (frame_buffer_index.write + 7) % 8;
+    pthread_mutex_unlock(&interrupts);
+    return result;
+}
+
+uint8_t avr_host_queued_slots(void) {
+    pthread_mutex_lock(&interrupts);
+    const uint8_t result = (frame_buffer_index.write - frame_buffer_index.read + 7) % 8;
+    pthread_mutex_unlock(&interrupts);
+    return result;
+}
+
+const volatile uint8_t* avr_host_slot(uint8_t index) {
+    return frame_buffer[index];
+}
+
+uint8_t avr_host_pind(void) {
+    return atomic_load(&pind);
+}
+
+uint8_t avr_host_pinc(void) {
+    if (atomic_load(&stopped)) {
+        pthread_exit(NULL);
+    }
+    if (yield) {
+        sched_yield();
+    }
+    return atomic_load(&pinc);
+}
+
+void avr_host_started(void) {
+    atomic_store(&started, 1);
+}
+
+void avr_host_disable_interrupts(void) {
+    pthread_mutex_lock(&interrupts);
+}
+
+void avr_host_enable_interrupts(void) {
+    pthread_mutex_unlock(&interrupts);
+}
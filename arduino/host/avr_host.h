@@ -0,0 +1,51 @@
+// The host build compiles arduino.c for the machine running the checks, with the stand-in AVR headers of this
+// directory (gcc -std=gnu11 -I arduino/host -Dmain=firmware_main). The firmware's main loop runs in a thread, the
+// harness calls the timer interrupt and drives the pins connected to the Raspberry Pi (see
+// pi/source/led_panel_firmware_check.cpp).
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// avr_host_start runs the firmware in a thread, and returns when the firmware enables interrupts.
+void avr_host_start(void);
+
+// avr_host_stop terminates the firmware thread at its next pin read.
+void avr_host_stop(void);
+
+// avr_host_interrupt calls the timer interrupt, unless the firmware is in an atomic block.
+void avr_host_interrupt(void);
+
+// avr_host_set_pins changes the input pins. pind is stored before pinc, hence the firmware never sees a request edge
+// before the data.
+void avr_host_set_pins(uint8_t pind, uint8_t pinc);
+
+// avr_host_portc returns the firmware's port C outputs.
+uint8_t avr_host_portc(void);
+
+// avr_host_frame_size returns the frame_size the firmware was compiled with.
+uint16_t avr_host_frame_size(void);
+
+// avr_host_committed_slot returns the index of the last committed frame buffer slot.
+uint8_t avr_host_committed_slot(void);
+
+// avr_host_queued_slots returns the number of committed slots queued behind the displayed one.
+uint8_t avr_host_queued_slots(void);
+
+// avr_host_slot returns a pointer to the given frame buffer slot (brightness, then pixels in wire order).
+const volatile uint8_t* avr_host_slot(uint8_t index);
+
+// The following functions are called by the stand-in headers.
+uint8_t avr_host_pind(void);
+uint8_t avr_host_pinc(void);
+void avr_host_started(void);
+void avr_host_disable_interrupts(void);
+void avr_host_enable_interrupts(void);
+
+#ifdef __cplusplus
+}
+#endif
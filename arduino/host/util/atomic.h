@@ -0,0 +1,12 @@
+// Stand-in for the AVR atomic blocks, used by the host build of the firmware (see avr_host.h).
+// An atomic block holds the lock that avr_host_interrupt takes to call the interrupt, hence the interrupt cannot run
+// in the middle of the block, as on the microcontroller.
+
+#pragma once
+
+#include "../avr_host.h"
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type)                                                                                             \
+    for (uint8_t avr_host_once = (avr_host_disable_interrupts(), 1); avr_host_once;                                   \
+         avr_host_once = (avr_host_enable_interrupts(), 0))
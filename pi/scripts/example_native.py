@@ -0,0 +1,26 @@
+import numpy
+import os
+import sys
+
+# led_panel_native is built by make in the build directory
+sys.path.append(os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), 'build'))
+import led_panel_native
+
+display = led_panel_native.display(2, 1) # number of horizontal and vertical panels
+width = display.width * 32
+height = display.height * 16
+
+x = 0
+y = 0
+while True:
+    frame = numpy.zeros((height, width), dtype=numpy.uint8)
+    frame[y, x] = 255
+    display.send(brightness=50, packed_frame=numpy.packbits(frame // 128))
+    if x < width - 1:
+        x += 1
+    else:
+        x = 0
+        if y < height - 1:
+            y += 1
+        else:
+            y = 0
@@ -1,27 +1,90 @@
 import atexit
+import ctypes
+import mmap
 import os
 import numpy
+import platform
 import subprocess
 
 panels_width = 2
 panels_height = 1
 
+# frames are written in place to a shared memory ring if use_shared_memory is True
+# otherwise, they are piped to the sink's standard input
+use_shared_memory = True
+ring_capacity = 4
+
 width = panels_width * 32
 height = panels_height * 16
+frame_size = width * height // 8 + 1
+
+sink = os.path.join(
+    os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+    'build',
+    'led_panel_sink')
+
+if use_shared_memory:
+    # see source/shared_frame_ring.hpp for the memory layout
+    futex_syscall = {'x86_64': 202, 'aarch64': 98, 'armv6l': 240, 'armv7l': 240, 'i686': 240}[platform.machine()]
+    futex_wait = 0
+    futex_wake = 1
+    futex_wake_op = 5
+    futex_op_add_one = (1 << 28) | (1 << 12) # FUTEX_OP(FUTEX_OP_ADD, 1, FUTEX_OP_CMP_EQ, 0)
+
+    class timespec(ctypes.Structure):
+        _fields_ = [('tv_sec', ctypes.c_long), ('tv_nsec', ctypes.c_long)]
+
+    libc = ctypes.CDLL(None, use_errno=True)
+    name = 'led_panel_{}'.format(os.getpid())
+    stride = (frame_size + 63) // 64 * 64
+    descriptor = os.open(os.path.join('/dev/shm', name), os.O_RDWR | os.O_CREAT | os.O_EXCL, 0o600)
+    os.ftruncate(descriptor, 64 + ring_capacity * stride)
+    memory = mmap.mmap(descriptor, 64 + ring_capacity * stride)
+    os.close(descriptor)
+    header = numpy.frombuffer(memory, dtype=numpy.uint32, count=16)
+    header[1:4] = [frame_size, ring_capacity, stride]
+    header[0] = 0x4c505352
+    slots = numpy.frombuffer(memory, dtype=numpy.uint8, offset=64).reshape((ring_capacity, stride))[:, :frame_size]
+    write_address = ctypes.addressof(ctypes.c_uint32.from_buffer(memory, 16))
+    read_address = ctypes.addressof(ctypes.c_uint32.from_buffer(memory, 20))
+    process = subprocess.Popen(args=[sink, str(panels_width), str(panels_height), '--shm', name])
+else:
+    process = subprocess.Popen(args=[sink, str(panels_width), str(panels_height)], stdin=subprocess.PIPE)
 
-process = subprocess.Popen(
-    args=[
-        os.path.join(
-            os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
-            'build',
-            'led_panel_sink'),
-        str(width // 32),
-        str(height // 16)],
-    stdin=subprocess.PIPE)
+def close():
+    if use_shared_memory:
+        header[6] = 1
+        libc.syscall(futex_syscall, ctypes.c_void_p(write_address), futex_wake, 1, None, None, 0)
+        try:
+            process.wait(timeout=1)
+        except subprocess.TimeoutExpired:
+            process.kill()
+        os.unlink(os.path.join('/dev/shm', name))
+    else:
+        process.kill()
+atexit.register(close)
 
-def kill_process():
-    process.kill()
-atexit.register(kill_process)
+def next_frame():
+    """
+    Returns a writable view of the next shared memory slot (numpy.uint8 array with frame_size elements)
+    The first byte is the brightness and the other bytes are the packed pixels (see pack)
+    The frame is sent to the display by publish_frame
+    Requires use_shared_memory
+    """
+    assert use_shared_memory
+    timeout = timespec(0, 100000000)
+    while (int(header[4]) - int(header[5])) % (1 << 32) >= ring_capacity:
+        if process.poll() is not None:
+            raise RuntimeError('led_panel_sink exited with code {}'.format(process.returncode))
+        libc.syscall(futex_syscall, ctypes.c_void_p(read_address), futex_wait, ctypes.c_uint32(int(header[5])), ctypes.byref(timeout), None, 0)
+    return slots[int(header[4]) % ring_capacity]
+
+def publish_frame():
+    """
+    Sends the frame returned by next_frame
+    """
+    # FUTEX_WAKE_OP increments the write counter atomically, with a memory barrier, and wakes the sink
+    libc.syscall(futex_syscall, ctypes.c_void_p(write_address), futex_wake_op, 1, None, ctypes.c_void_p(write_address), futex_op_add_one)
 
 def send(brightness, packed_frame):
     """
@@ -34,9 +97,15 @@ def send(brightness, packed_frame):
     assert type(packed_frame) is numpy.ndarray
     assert packed_frame.dtype is numpy.dtype('uint8')
     assert packed_frame.size == width * height // 8
-    process.stdin.write(bytes([brightness]))
-    process.stdin.write(packed_frame.tobytes())
-    process.stdin.flush()
+    if use_shared_memory:
+        frame = next_frame()
+        frame[0] = brightness
+        frame[1:] = packed_frame.reshape(-1)
+        publish_frame()
+    else:
+        process.stdin.write(bytes([brightness]))
+        process.stdin.write(packed_frame.tobytes())
+        process.stdin.flush()
 
 def pack(frame):
     """
@@ -0,0 +1,43 @@
+import socket
+import struct
+
+# see source/compositor.hpp for the protocol
+geometry_message = 1
+pixels_message = 2
+blend_ops = {'overwrite': 0, 'or': 1, 'xor': 2, 'mask': 3}
+
+class layer:
+    """
+    Controls a layer of led_panel_compositor
+    The layer is created on connection and deleted by close (or when the process exits)
+    """
+
+    def __init__(self, path, x, y, width, height, z=0, blend='overwrite'):
+        self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.socket.connect(path)
+        self.set_geometry(x, y, width, height, z, blend)
+
+    def set_geometry(self, x, y, width, height, z=0, blend='overwrite', visible=True):
+        """
+        Moves, resizes or restacks the layer (coordinates in pixels, layers with larger z are drawn on top)
+        blend is 'overwrite', 'or', 'xor' or 'mask'
+        Resizing the layer turns its pixels off
+        """
+        self.width = width
+        self.height = height
+        self.socket.sendall(struct.pack(
+            '=BBBBhhHHiI', geometry_message, blend_ops[blend], int(visible), 0, x, y, width, height, z, 0))
+
+    def send(self, packed_pixels):
+        """
+        Replaces the layer's pixels
+        packed_pixels has (width + 7) // 8 bytes per row, for instance numpy.packbits(image // 128, axis=1)
+        or a led_panel_native.raster with the layer's size
+        """
+        pixels = memoryview(packed_pixels).cast('B')
+        assert len(pixels) == (self.width + 7) // 8 * self.height
+        self.socket.sendall(struct.pack('=BBBBhhHHiI', pixels_message, 0, 0, 0, 0, 0, 0, 0, 0, len(pixels)))
+        self.socket.sendall(pixels)
+
+    def close(self):
+        self.socket.close()
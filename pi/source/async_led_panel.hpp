@@ -0,0 +1,258 @@
+#pragma once
+
+#include "realtime.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// backpressure selects the behaviour of frame_queue::push when the queue is full.
+enum class backpressure {
+    /// block waits until the consumer frees a slot.
+    block,
+
+    /// drop_oldest discards the oldest queued frame to make room for the new one.
+    drop_oldest,
+
+    /// drop_newest discards the new frame.
+    drop_newest,
+};
+
+/// wait_a_little is called by busy loops, it yields first and sleeps if the wait lasts longer.
+inline void wait_a_little(uint32_t& iteration) {
+    if (iteration < 64) {
+        ++iteration;
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+/// frame_queue is a bounded single-producer single-consumer queue of preallocated frames.
+/// push and pop copy frames, hence the queue never allocates after construction.
+/// The queue is lock-free, with one exception: a producer that drops the oldest frames can catch up with a frame that
+/// the consumer is copying. In this case, the producer waits for the end of the copy.
+class frame_queue {
+    public:
+    frame_queue(std::size_t capacity, std::size_t frame_size, backpressure policy) :
+        _capacity(capacity),
+        _frame_size(frame_size),
+        _policy(policy),
+        _slots((capacity + 1) * frame_size),
+        _write(0),
+        _read(0),
+        _reading(idle),
+        _dropped(0) {
+        if (_capacity == 0) {
+            throw std::logic_error("the queue capacity must be larger than 0");
+        }
+    }
+    frame_queue(const frame_queue&) = delete;
+    frame_queue(frame_queue&& other) = delete;
+    frame_queue& operator=(const frame_queue&) = delete;
+    frame_queue& operator=(frame_queue&& other) = delete;
+    virtual ~frame_queue() {}
+
+    /// push copies a frame (frame_size bytes) into the queue.
+    /// It returns false if the frame was dropped (drop_newest policy).
+    /// push must only be called by the producer.
+    bool push(const uint8_t* frame) {
+        const auto write = _write.load(std::memory_order_relaxed);
+        uint32_t iteration = 0;
+        for (auto read = _read.load(); write - read >= _capacity; read = _read.load()) {
+            switch (_policy) {
+                case backpressure::block:
+                    wait_a_little(iteration);
+                    break;
+                case backpressure::drop_oldest:
+                    if (_read.compare_exchange_weak(read, read + 1)) {
+                        _dropped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    break;
+                case backpressure::drop_newest:
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+            }
+        }
+        iteration = 0;
+        for (auto reading = _reading.load(); reading != idle && (write - reading) % (_capacity + 1) == 0;
+             reading = _reading.load()) {
+            wait_a_little(iteration);
+        }
+        std::memcpy(_slots.data() + (write % (_capacity + 1)) * _frame_size, frame, _frame_size);
+        _write.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// pop copies the oldest frame into destination (frame_size bytes).
+    /// It returns false if the queue is empty.
+    /// pop must only be called by the consumer.
+    bool pop(uint8_t* destination) {
+        for (auto read = _read.load(); read != _write.load(std::memory_order_acquire); read = _read.load()) {
+            _reading.store(read);
+            if (_read.compare_exchange_strong(read, read + 1)) {
+                std::memcpy(destination, _slots.data() + (read % (_capacity + 1)) * _frame_size, _frame_size);
+                _reading.store(idle);
+                return true;
+            }
+        }
+        _reading.store(idle);
+        return false;
+    }
+
+    /// size returns the number of queued frames.
+    std::size_t size() const {
+        return _write.load() - _read.load();
+    }
+
+    /// dropped returns the number of frames discarded by the backpressure policy.
+    uint64_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    protected:
+    /// idle means that the consumer is not copying a slot.
+    static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+    const std::size_t _capacity;
+    const std::size_t _frame_size;
+    const backpressure _policy;
+    std::vector<uint8_t> _slots;
+    std::atomic<uint64_t> _write;
+    std::atomic<uint64_t> _read;
+    std::atomic<uint64_t> _reading;
+    std::atomic<uint64_t> _dropped;
+};
+
+/// async_led_panel transmits frames to a led_panel from a dedicated thread.
+/// submit copies a frame into a frame_queue and returns, so that the caller can render the next frame while the
+/// previous one is being transmitted. The transmit thread is pinned to core if core is not negative, and runs with the
+/// SCHED_FIFO policy if priority is larger than 0 (see realtime.hpp). If a transfer throws (acknowledge timeout), the
+/// thread discards the following frames and every later call to submit or flush rethrows the exception, until recover
+/// succeeds.
+template <typename Panel>
+class async_led_panel {
+    public:
+    async_led_panel(
+        Panel& panel,
+        std::size_t capacity = 2,
+        backpressure policy = backpressure::block,
+        int32_t core = -1,
+        int32_t priority = 0) :
+        _panel(panel),
+        _queue(capacity, panel.frame_size() + 1, policy),
+        _frame(panel.frame_size() + 1),
+        _running(true),
+        _busy(false),
+        _failed(false) {
+        _loop = std::thread([this]() {
+            uint32_t iteration = 0;
+            for (;;) {
+                _busy.store(true);
+                if (_queue.pop(_frame.data())) {
+                    if (!_failed.load()) {
+                        try {
+                            _panel.send(_frame);
+                        } catch (...) {
+                            _error = std::current_exception();
+                            _failed.store(true);
+                        }
+                    }
+                    iteration = 0;
+                } else {
+                    _busy.store(false);
+                    if (!_running.load()) {
+                        break;
+                    }
+                    wait_a_little(iteration);
+                }
+            }
+        });
+        try {
+            set_thread_scheduling(_loop.native_handle(), priority, core);
+        } catch (...) {
+            _running.store(false);
+            _loop.join();
+            throw;
+        }
+    }
+    async_led_panel(const async_led_panel&) = delete;
+    async_led_panel(async_led_panel&& other) = delete;
+    async_led_panel& operator=(const async_led_panel&) = delete;
+    async_led_panel& operator=(async_led_panel&& other) = delete;
+
+    /// the destructor transmits the queued frames before returning.
+    virtual ~async_led_panel() {
+        _running.store(false);
+        _loop.join();
+    }
+
+    /// submit queues a frame for transmission.
+    /// The frame must have width * height * 64 bytes. submit returns false if the frame was dropped.
+    bool submit(const std::vector<uint8_t>& frame) {
+        if (frame.size() != _frame.size()) {
+            throw std::logic_error("bad frame size");
+        }
+        return submit(frame.data());
+    }
+
+    /// submit queues a frame stored in contiguous memory (width * height * 64 + 1 bytes).
+    bool submit(const uint8_t* frame) {
+        rethrow_error();
+        return _queue.push(frame);
+    }
+
+    /// flush waits until all the submitted frames have been transmitted.
+    void flush() {
+        uint32_t iteration = 0;
+        while (_queue.size() > 0 || _busy.load()) {
+            wait_a_little(iteration);
+        }
+        rethrow_error();
+    }
+
+    /// recover clears the error of a failed transfer, so that submit and flush transmit frames again.
+    /// It waits until the thread has discarded the queued frames, and resyncs the panel before clearing the error.
+    /// If resync throws, the error is kept. recover does nothing if no transfer failed.
+    void recover() {
+        if (!_failed.load()) {
+            return;
+        }
+        uint32_t iteration = 0;
+        while (_queue.size() > 0 || _busy.load()) {
+            wait_a_little(iteration);
+        }
+        _panel.resync();
+        _error = nullptr;
+        _failed.store(false);
+    }
+
+    /// dropped returns the number of frames discarded by the backpressure policy.
+    uint64_t dropped() const {
+        return _queue.dropped();
+    }
+
+    protected:
+    /// rethrow_error throws the exception of a failed transfer, if any.
+    void rethrow_error() {
+        if (_failed.load()) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+    Panel& _panel;
+    frame_queue _queue;
+    std::vector<uint8_t> _frame;
+    std::atomic_bool _running;
+    std::atomic_bool _busy;
+    std::atomic_bool _failed;
+    std::exception_ptr _error;
+    std::thread _loop;
+};
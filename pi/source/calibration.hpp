@@ -0,0 +1,239 @@
+#pragma once
+
+#include "led_panel.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+/// calibration_result summarizes a handshake calibration.
+struct calibration_result {
+    /// timing is the calibrated timing, including the safety margin.
+    handshake_timing timing;
+
+    /// byte_duration is the median duration of a byte transfer with the calibrated timing.
+    std::chrono::nanoseconds byte_duration;
+
+    /// acknowledge_latency is the part of a byte transfer that is not spent in delays, measured with the default
+    /// timing.
+    std::chrono::nanoseconds acknowledge_latency;
+};
+
+/// calibration_candidates lists the tested delays, in decreasing order.
+constexpr std::array<uint16_t, 13> calibration_candidates = {64, 48, 32, 24, 16, 12, 8, 6, 4, 3, 2, 1, 0};
+
+/// nop_duration measures the duration of a nop instruction.
+inline std::chrono::duration<double, std::nano> nop_duration() {
+    constexpr uint32_t nops = 1 << 20;
+    const auto begin = std::chrono::steady_clock::now();
+    for (uint32_t index = 0; index < nops; ++index) {
+        asm volatile("nop");
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin) / nops;
+}
+
+/// calibration_patterns generates the verification frames: uniform levels, alternating bits, a walking bit and
+/// random bytes, which toggle every data pin in both directions.
+inline std::vector<std::vector<uint8_t>> calibration_patterns(uint16_t frame_size, std::size_t count) {
+    std::vector<std::vector<uint8_t>> patterns(count, std::vector<uint8_t>(frame_size + 1));
+    std::mt19937 engine(frame_size);
+    std::uniform_int_distribution<uint16_t> distribution(0, 255);
+    for (std::size_t pattern = 0; pattern < count; ++pattern) {
+        patterns[pattern][0] = static_cast<uint8_t>(distribution(engine));
+        for (uint16_t index = 1; index < frame_size + 1; ++index) {
+            switch (pattern % 6) {
+                case 0:
+                    patterns[pattern][index] = 0x00;
+                    break;
+                case 1:
+                    patterns[pattern][index] = 0xff;
+                    break;
+                case 2:
+                    patterns[pattern][index] = (index & 1) ? 0x55 : 0xaa;
+                    break;
+                case 3:
+                    patterns[pattern][index] = (index & 1) ? 0xaa : 0x55;
+                    break;
+                case 4:
+                    patterns[pattern][index] = static_cast<uint8_t>(1 << (index % 8));
+                    break;
+                default:
+                    patterns[pattern][index] = static_cast<uint8_t>(distribution(engine));
+                    break;
+            }
+        }
+    }
+    return patterns;
+}
+
+/// verify_timing transmits the patterns with the given timing, and returns the median byte duration.
+/// Each pattern is sent with verify, hence the firmware checks the content of every frame with a checksum echo.
+/// The verification fails (the function returns false) if a checksum does not match, or if a byte is not
+/// acknowledged before the timeout.
+template <typename Panel>
+bool verify_timing(
+    Panel& panel,
+    handshake_timing timing,
+    const std::vector<std::vector<uint8_t>>& patterns,
+    std::chrono::nanoseconds& byte_duration) {
+    panel.set_timing(timing);
+    std::vector<std::chrono::nanoseconds> durations;
+    durations.reserve(patterns.size());
+    for (const auto& pattern : patterns) {
+        try {
+            if (!panel.verify(pattern)) {
+                return false;
+            }
+        } catch (const std::runtime_error&) {
+            panel.resync();
+            return false;
+        }
+        durations.push_back(panel.transfer_duration());
+    }
+    std::sort(durations.begin(), durations.end());
+    byte_duration = durations[durations.size() / 2] / (panel.frame_size() + 1);
+    return true;
+}
+
+/// latency_margin_divisor sets the latency-derived part of the safety margin (see calibrate), which scales the margin
+/// with the handshake's time scale (a slower Raspberry Pi or a slower firmware loop gets a larger margin).
+constexpr uint16_t latency_margin_divisor = 128;
+
+/// latency_margin converts an acknowledge latency to the latency-derived part of the safety margin, in nops.
+inline uint16_t latency_margin(
+    std::chrono::nanoseconds acknowledge_latency,
+    std::chrono::duration<double, std::nano> nop) {
+    return static_cast<uint16_t>(std::min<double>(
+        std::chrono::duration<double, std::nano>(acknowledge_latency) / nop / latency_margin_divisor,
+        std::numeric_limits<uint16_t>::max()));
+}
+
+/// calibrated_delay adds the safety margin to the smallest passing delay. The margin is the largest of the passing
+/// delay, the latency margin and 1 nop, and the result is bounded by the default delay.
+inline uint16_t calibrated_delay(uint16_t passing, uint16_t latency_margin, uint16_t default_delay) {
+    const auto margin = std::max<uint32_t>({passing, latency_margin, 1});
+    return static_cast<uint16_t>(std::min<uint32_t>(passing + margin, default_delay));
+}
+
+/// calibrate finds the smallest safe hold and setup delays.
+/// The acknowledge latency (the part of a byte transfer that is not spent in delays) is measured with the default
+/// timing. Then the hold delay is minimized (with the default setup delay), then the setup delay. Each candidate must
+/// pass verify_timing. The calibrated delays are the smallest passing delays plus a safety margin (see
+/// calibrated_delay and latency_margin). The panel's timing is set to the result, and its acknowledge timeout is
+/// restored.
+template <typename Panel>
+calibration_result calibrate(Panel& panel, std::size_t frames = 12) {
+    const auto patterns = calibration_patterns(panel.frame_size(), frames);
+    const auto nop = nop_duration();
+    const auto acknowledge_timeout = panel.acknowledge_timeout();
+    const auto recovery_attempts = panel.recovery_attempts();
+    panel.set_acknowledge_timeout(recommended_acknowledge_timeout);
+    std::chrono::nanoseconds byte_duration;
+    if (!verify_timing(panel, default_handshake_timing, patterns, byte_duration)) {
+        panel.set_acknowledge_timeout(acknowledge_timeout, recovery_attempts);
+        panel.set_timing(default_handshake_timing);
+        throw std::runtime_error("the default timing failed the verification");
+    }
+    const auto acknowledge_latency = std::max(
+        std::chrono::nanoseconds(0),
+        byte_duration
+            - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                nop * (default_handshake_timing.setup + default_handshake_timing.hold)));
+    const auto margin = latency_margin(acknowledge_latency, nop);
+    auto timing = default_handshake_timing;
+    for (const auto hold : calibration_candidates) {
+        if (!verify_timing(panel, {timing.setup, hold}, patterns, byte_duration)) {
+            break;
+        }
+        timing.hold = hold;
+    }
+    for (const auto setup : calibration_candidates) {
+        if (!verify_timing(panel, {setup, timing.hold}, patterns, byte_duration)) {
+            break;
+        }
+        timing.setup = setup;
+    }
+    timing.setup = calibrated_delay(timing.setup, margin, default_handshake_timing.setup);
+    timing.hold = calibrated_delay(timing.hold, margin, default_handshake_timing.hold);
+    calibration_result result{timing, std::chrono::nanoseconds(0), acknowledge_latency};
+    if (!verify_timing(panel, timing, patterns, result.byte_duration)) {
+        result.timing = default_handshake_timing;
+        verify_timing(panel, result.timing, patterns, result.byte_duration);
+    }
+    panel.set_timing(result.timing);
+    panel.set_acknowledge_timeout(acknowledge_timeout, recovery_attempts);
+    return result;
+}
+
+/// device_identifier returns a string that identifies the Raspberry Pi (model and serial number).
+/// The host name is used if the device tree is not available.
+inline std::string device_identifier() {
+    std::string identifier;
+    for (const auto path : {"/proc/device-tree/model", "/proc/device-tree/serial-number"}) {
+        std::ifstream input(path);
+        std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        content.erase(std::remove(content.begin(), content.end(), '\0'), content.end());
+        if (!content.empty()) {
+            identifier += (identifier.empty() ? "" : " ") + content;
+        }
+    }
+    if (identifier.empty()) {
+        std::array<char, 256> name{};
+        gethostname(name.data(), name.size() - 1);
+        identifier = name.data();
+    }
+    std::replace(identifier.begin(), identifier.end(), '\n', ' ');
+    return identifier;
+}
+
+/// default_timing_path returns the file where calibrated timings are stored.
+inline std::string default_timing_path() {
+    const auto home = std::getenv("HOME");
+    return std::string(home == nullptr ? "." : home) + "/.led_panel_timing";
+}
+
+/// load_timing reads the timing of the given device from a timing file.
+/// Each line of the file has the format "setup hold device". load_timing returns false if the device is not listed.
+inline bool load_timing(const std::string& path, const std::string& device, handshake_timing& timing) {
+    std::ifstream input(path);
+    for (std::string line; std::getline(input, line);) {
+        std::istringstream stream(line);
+        handshake_timing candidate;
+        std::string candidate_device;
+        if (stream >> candidate.setup >> candidate.hold && std::getline(stream >> std::ws, candidate_device)
+            && candidate_device == device) {
+            timing = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// save_timing writes the timing of the given device to a timing file, and preserves the other devices' timings.
+inline void save_timing(const std::string& path, const std::string& device, handshake_timing timing) {
+    std::vector<std::string> lines;
+    {
+        std::ifstream input(path);
+        for (std::string line; std::getline(input, line);) {
+            std::istringstream stream(line);
+            handshake_timing candidate;
+            std::string candidate_device;
+            if (!(stream >> candidate.setup >> candidate.hold && std::getline(stream >> std::ws, candidate_device)
+                  && candidate_device == device)) {
+                lines.push_back(line);
+            }
+        }
+    }
+    lines.push_back(std::to_string(timing.setup) + " " + std::to_string(timing.hold) + " " + device);
+    std::ofstream output(path, std::ofstream::trunc);
+    if (!output.good()) {
+        throw std::runtime_error("'" + path + "' could not be opened in write mode");
+    }
+    for (const auto& line : lines) {
+        output << line << "\n";
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "led_panel.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/// clip_order is the pixel order of clip records.
+enum class clip_order : uint8_t {
+    /// row_major records store packed frames, as sent to led_panel_sink.
+    row_major = 0,
+
+    /// wire records store the pixels in transmission order (see fill_wire_order), hence they are played without
+    /// permutation.
+    wire = 1,
+};
+
+/// clip_header is the memory layout of the first 64 bytes of a clip file.
+///
+/// A clip is a pre-packed animation (native endianness):
+///     - offset  0: magic (uint32, 0x4c50434c)
+///     - offset  4: version (uint32, 1)
+///     - offset  8: width (uint8), the number of horizontal panels
+///     - offset  9: height (uint8), the number of vertical panels
+///     - offset 10: order (uint8, see clip_order)
+///     - offset 12: frame_rate_numerator (uint32)
+///     - offset 16: frame_rate_denominator (uint32), the frame rate is frame_rate_numerator / frame_rate_denominator
+///     - offset 20: stride (uint32), the distance between records in bytes (width * height * 64 + 1 rounded up to 64)
+///     - offset 24: frames (uint64), the number of records
+/// The records follow the header. A record has the brightness byte, then width * height * 64 pixel bytes.
+struct clip_header {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t width;
+    uint8_t height;
+    clip_order order;
+    uint8_t reserved_byte;
+    uint32_t frame_rate_numerator;
+    uint32_t frame_rate_denominator;
+    uint32_t stride;
+    uint64_t frames;
+    uint32_t reserved[8];
+};
+static_assert(sizeof(clip_header) == 64, "the clip header must be 64 bytes long");
+
+/// clip_magic_number identifies a clip file.
+constexpr uint32_t clip_magic_number = 0x4c50434c;
+
+/// clip_version is the version of the clip format.
+constexpr uint32_t clip_version = 1;
+
+/// clip_stride returns the size of a record, padded to a multiple of 64 bytes.
+constexpr uint32_t clip_stride(uint8_t width, uint8_t height) {
+    return (64 * width * height + 1 + 63) / 64 * 64;
+}
+
+/// clip maps a clip file in read-only memory.
+/// Records are read in place from the page cache: playback requires neither copies nor conversions, and starts
+/// before the file is fully loaded.
+class clip {
+    public:
+    clip(const std::string& path) {
+        const auto file_descriptor = open(path.c_str(), O_RDONLY);
+        if (file_descriptor < 0) {
+            throw std::runtime_error("'" + path + "' could not be opened");
+        }
+        struct stat status;
+        if (fstat(file_descriptor, &status) < 0 || static_cast<std::size_t>(status.st_size) < sizeof(clip_header)) {
+            ::close(file_descriptor);
+            throw std::runtime_error("'" + path + "' is not a clip");
+        }
+        _size = status.st_size;
+        auto map = mmap(nullptr, _size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+        ::close(file_descriptor);
+        if (map == MAP_FAILED) {
+            throw std::runtime_error("mmap failed");
+        }
+        _header = reinterpret_cast<const clip_header*>(map);
+        _records = reinterpret_cast<const uint8_t*>(map) + sizeof(clip_header);
+        if (_header->magic != clip_magic_number || _header->version != clip_version || _header->width == 0
+            || _header->height == 0 || _header->frame_rate_numerator == 0 || _header->frame_rate_denominator == 0
+            || _header->stride < 64u * _header->width * _header->height + 1
+            || (_size - sizeof(clip_header)) / _header->stride < _header->frames) {
+            munmap(map, _size);
+            throw std::runtime_error("'" + path + "' is not a valid clip");
+        }
+        madvise(map, _size, MADV_WILLNEED);
+    }
+    clip(const clip&) = delete;
+    clip(clip&& other) = delete;
+    clip& operator=(const clip&) = delete;
+    clip& operator=(clip&& other) = delete;
+    virtual ~clip() {
+        munmap(const_cast<clip_header*>(_header), _size);
+    }
+
+    /// header returns the clip properties.
+    const clip_header& header() const {
+        return *_header;
+    }
+
+    /// frames returns the number of records.
+    uint64_t frames() const {
+        return _header->frames;
+    }
+
+    /// frame_rate returns the clip's frame rate in Hz.
+    double frame_rate() const {
+        return static_cast<double>(_header->frame_rate_numerator) / _header->frame_rate_denominator;
+    }
+
+    /// record returns a pointer to the brightness byte of the given frame, followed by its pixels.
+    const uint8_t* record(uint64_t index) const {
+        return _records + index * _header->stride;
+    }
+
+    protected:
+    std::size_t _size;
+    const clip_header* _header;
+    const uint8_t* _records;
+};
+
+/// clip_writer creates a clip file.
+/// The number of frames is written to the header by the destructor.
+class clip_writer {
+    public:
+    clip_writer(
+        const std::string& path,
+        uint8_t width,
+        uint8_t height,
+        clip_order order,
+        uint32_t frame_rate_numerator,
+        uint32_t frame_rate_denominator = 1) :
+        _header{},
+        _wire_order(order == clip_order::wire ? dynamic_wire_order(width, height) : std::vector<uint16_t>()),
+        _record(clip_stride(width, height), 0) {
+        if (width == 0 || height == 0) {
+            throw std::logic_error("width and height must be larger than 0");
+        }
+        if (frame_rate_numerator == 0 || frame_rate_denominator == 0) {
+            throw std::logic_error("the frame rate must be larger than 0");
+        }
+        _header.magic = clip_magic_number;
+        _header.version = clip_version;
+        _header.width = width;
+        _header.height = height;
+        _header.order = order;
+        _header.frame_rate_numerator = frame_rate_numerator;
+        _header.frame_rate_denominator = frame_rate_denominator;
+        _header.stride = clip_stride(width, height);
+        _file_descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_file_descriptor < 0) {
+            throw std::runtime_error("'" + path + "' could not be created");
+        }
+        write_all(&_header, sizeof(clip_header));
+    }
+    clip_writer(const clip_writer&) = delete;
+    clip_writer(clip_writer&& other) = delete;
+    clip_writer& operator=(const clip_writer&) = delete;
+    clip_writer& operator=(clip_writer&& other) = delete;
+    virtual ~clip_writer() {
+        // destructors must not throw, the clip keeps a zero frame count if this write fails
+        [[maybe_unused]] const auto written = pwrite(_file_descriptor, &_header, sizeof(clip_header), 0);
+        ::close(_file_descriptor);
+    }
+
+    /// write appends a frame to the clip.
+    /// pixels must point to width * height * 64 packed bytes in row major order.
+    void write(uint8_t brightness, const uint8_t* pixels) {
+        _record[0] = brightness;
+        if (_header.order == clip_order::wire) {
+            for (std::size_t index = 0; index < _wire_order.size(); ++index) {
+                _record[index + 1] = pixels[_wire_order[index]];
+            }
+        } else {
+            std::copy(pixels, pixels + 64 * _header.width * _header.height, std::next(_record.begin()));
+        }
+        write_all(_record.data(), _record.size());
+        ++_header.frames;
+    }
+
+    /// frames returns the number of written frames.
+    uint64_t frames() const {
+        return _header.frames;
+    }
+
+    protected:
+    /// write_all writes size bytes to the file, or throws.
+    void write_all(const void* data, std::size_t size) {
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        while (size > 0) {
+            const auto written = ::write(_file_descriptor, bytes, size);
+            if (written <= 0) {
+                throw std::runtime_error("writing the clip failed");
+            }
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    clip_header _header;
+    const std::vector<uint16_t> _wire_order;
+    std::vector<uint8_t> _record;
+    int32_t _file_descriptor;
+};
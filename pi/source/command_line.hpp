@@ -0,0 +1,55 @@
+#pragma once
+
+#include "grayscale_packer.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+/// string_to_uint8 parses a command line argument in the range [0, 255].
+inline uint8_t string_to_uint8(const std::string& name, const std::string& input) {
+    const auto candidate = stoul(input);
+    if (candidate > 255) {
+        throw std::out_of_range(name + " must be smaller than 256");
+    }
+    return static_cast<uint8_t>(candidate);
+}
+
+/// option_value returns the argument following the option at index, and moves index to it.
+inline std::string option_value(int argc, char* argv[], int& index) {
+    if (index + 1 >= argc) {
+        throw std::runtime_error(std::string(argv[index]) + " requires a value");
+    }
+    ++index;
+    return argv[index];
+}
+
+/// string_to_dithering parses a dithering method name.
+inline dithering string_to_dithering(const std::string& input) {
+    if (input == "threshold") {
+        return dithering::threshold;
+    }
+    if (input == "ordered") {
+        return dithering::ordered;
+    }
+    if (input == "error-diffusion") {
+        return dithering::error_diffusion;
+    }
+    throw std::runtime_error("unknown dithering method '" + input + "'");
+}
+
+/// write_all writes size bytes to the standard output, or throws.
+inline void write_all(const uint8_t* bytes, std::size_t size) {
+    while (size > 0) {
+        const auto written = ::write(STDOUT_FILENO, bytes, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw std::runtime_error("writing to the standard output failed");
+        }
+        bytes += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "packed_raster.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+/// blend_op selects how a layer is combined with the layers below it.
+enum class blend_op : uint8_t {
+    /// overwrite replaces the pixels below the layer's rectangle (the layer is opaque).
+    overwrite = 0,
+
+    /// bitwise_or turns on the pixels where the layer is on.
+    bitwise_or = 1,
+
+    /// bitwise_xor inverts the pixels where the layer is on.
+    bitwise_xor = 2,
+
+    /// mask turns off the pixels of the layer's rectangle where the layer is off.
+    mask = 3,
+};
+
+/// layer_geometry describes the position and the blending of a layer.
+/// Coordinates are display pixels, and the rectangle may extend beyond the display.
+struct layer_geometry {
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    int32_t z;
+    blend_op blend;
+    bool visible;
+};
+
+/// layer_stride returns the number of bytes per row of a layer's pixels.
+constexpr uint32_t layer_stride(uint16_t width) {
+    return (width + 7u) / 8u;
+}
+
+/// compositor_message_type identifies a message sent by a compositor client.
+enum class compositor_message_type : uint8_t {
+    /// geometry sets the client layer's rectangle, z-order, blend op and visibility. Resizing a layer turns its
+    /// pixels off.
+    geometry = 1,
+
+    /// pixels replaces the client layer's pixels. The message is followed by size bytes, layer_stride(width) bytes per
+    /// row (8 pixels per byte, most significant bit first, the layout of numpy.packbits(image, axis=1)).
+    pixels = 2,
+};
+
+/// compositor_message is the memory layout of a message header (native endianness, 20 bytes).
+///     - offset  0: type (uint8, see compositor_message_type)
+///     - offset  1: blend (uint8, see blend_op)
+///     - offset  2: visible (uint8, 0 or 1)
+///     - offset  4: x (int16), y (int16), width (uint16) and height (uint16), in pixels
+///     - offset 12: z (int32), layers with larger values are drawn on top
+///     - offset 16: size (uint32), the number of bytes that follow the header
+/// Geometry messages use every field and size must be 0. Pixels messages only use type and size.
+/// In Python, struct.pack("=BBBBhhHHiI", type, blend, visible, 0, x, y, width, height, z, size) packs a header.
+struct compositor_message {
+    compositor_message_type type;
+    uint8_t blend;
+    uint8_t visible;
+    uint8_t reserved;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    int32_t z;
+    uint32_t size;
+};
+static_assert(sizeof(compositor_message) == 20, "the compositor message header must be 20 bytes long");
+
+/// compositor stacks 1-bpp layers into a packed frame.
+/// Layers are drawn bottom to top (by z, then by creation order) on a blank frame, with word-wide blits (see
+/// packed_raster). The frame is recomposited only after a layer changed.
+class compositor {
+    public:
+    /// maximum_size is the largest layer width or height in pixels (255 panels).
+    static constexpr uint16_t maximum_size = 32 * 255;
+
+    compositor(uint8_t width, uint8_t height) : _raster(width, height), _next_identifier(0), _changed(true) {}
+    compositor(const compositor&) = delete;
+    compositor(compositor&& other) = delete;
+    compositor& operator=(const compositor&) = delete;
+    compositor& operator=(compositor&& other) = delete;
+    virtual ~compositor() {}
+
+    /// add_layer creates an empty, invisible layer and returns its identifier.
+    uint32_t add_layer() {
+        _layers.push_back({_next_identifier, {0, 0, 0, 0, 0, blend_op::overwrite, false}, {}});
+        return _next_identifier++;
+    }
+
+    /// remove_layer deletes a layer.
+    void remove_layer(uint32_t identifier) {
+        const auto layer = find(identifier);
+        if (layer->geometry.visible) {
+            _changed = true;
+        }
+        _layers.erase(layer);
+    }
+
+    /// set_geometry moves, resizes or restacks a layer.
+    /// The layer's pixels are kept if its size does not change, and turned off otherwise.
+    void set_geometry(uint32_t identifier, const layer_geometry& geometry) {
+        if (geometry.width > maximum_size || geometry.height > maximum_size) {
+            throw std::logic_error("layers must be smaller than 8161 x 8161 pixels");
+        }
+        if (static_cast<uint8_t>(geometry.blend) > static_cast<uint8_t>(blend_op::mask)) {
+            throw std::logic_error("unknown blend op " + std::to_string(static_cast<uint32_t>(geometry.blend)));
+        }
+        auto layer = find(identifier);
+        if (geometry.width != layer->geometry.width || geometry.height != layer->geometry.height) {
+            layer->pixels.assign(static_cast<std::size_t>(layer_stride(geometry.width)) * geometry.height, 0);
+        }
+        layer->geometry = geometry;
+        _changed = true;
+    }
+
+    /// set_pixels replaces a layer's pixels (layer_stride(width) * height bytes).
+    void set_pixels(uint32_t identifier, const uint8_t* pixels, std::size_t size) {
+        auto layer = find(identifier);
+        if (size != layer->pixels.size()) {
+            throw std::logic_error(
+                "the layer expects " + std::to_string(layer->pixels.size()) + " bytes (got " + std::to_string(size)
+                + ")");
+        }
+        std::copy(pixels, pixels + size, layer->pixels.begin());
+        if (layer->geometry.visible) {
+            _changed = true;
+        }
+    }
+
+    /// set_brightness changes the brightness byte of the frame.
+    void set_brightness(uint8_t brightness) {
+        _raster.set_brightness(brightness);
+        _changed = true;
+    }
+
+    /// changed returns true if the frame must be recomposited.
+    bool changed() const {
+        return _changed;
+    }
+
+    /// layers returns the number of layers.
+    std::size_t layers() const {
+        return _layers.size();
+    }
+
+    /// composite returns the brightness byte followed by the packed pixels (see led_panel::send).
+    /// The layers are recomposited if changed returns true.
+    const std::vector<uint8_t>& composite() {
+        if (_changed) {
+            // stable_sort keeps the creation order of layers with the same z
+            std::stable_sort(_layers.begin(), _layers.end(), [](const layer& first, const layer& second) {
+                return first.geometry.z < second.geometry.z;
+            });
+            _raster.reset_clip();
+            _raster.clear();
+            for (const auto& layer : _layers) {
+                if (!layer.geometry.visible || layer.pixels.empty()) {
+                    continue;
+                }
+                _raster.blit(
+                    {layer.geometry.width,
+                     layer.geometry.height,
+                     static_cast<uint16_t>(layer_stride(layer.geometry.width)),
+                     layer.pixels.data()},
+                    layer.geometry.x,
+                    layer.geometry.y,
+                    to_raster_op(layer.geometry.blend));
+            }
+            _changed = false;
+        }
+        return _raster.frame();
+    }
+
+    protected:
+    /// layer holds the state of a client layer.
+    struct layer {
+        uint32_t identifier;
+        layer_geometry geometry;
+        std::vector<uint8_t> pixels;
+    };
+
+    /// to_raster_op returns the raster operation that implements a blend op.
+    static raster_op to_raster_op(blend_op blend) {
+        switch (blend) {
+            case blend_op::overwrite:
+                return raster_op::copy;
+            case blend_op::bitwise_or:
+                return raster_op::bitwise_or;
+            case blend_op::bitwise_xor:
+                return raster_op::bitwise_xor;
+            case blend_op::mask:
+                return raster_op::bitwise_and;
+        }
+        return raster_op::copy;
+    }
+
+    /// find returns the layer with the given identifier, or throws.
+    std::vector<layer>::iterator find(uint32_t identifier) {
+        const auto layer = std::find_if(_layers.begin(), _layers.end(), [&](const struct layer& candidate) {
+            return candidate.identifier == identifier;
+        });
+        if (layer == _layers.end()) {
+            throw std::logic_error("unknown layer " + std::to_string(identifier));
+        }
+        return layer;
+    }
+
+    packed_raster _raster;
+    std::vector<layer> _layers;
+    uint32_t _next_identifier;
+    bool _changed;
+};
+
+/// compositor_client controls a layer of led_panel_compositor.
+/// The layer is created when the client connects and deleted when it disconnects.
+class compositor_client {
+    public:
+    compositor_client(const std::string& path) : _width(0), _height(0) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::logic_error("the socket path must be shorter than " + std::to_string(sizeof(address.sun_path))
+                                   + " characters");
+        }
+        address.sun_family = AF_UNIX;
+        std::copy(path.begin(), path.end(), address.sun_path);
+        _file_descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_file_descriptor < 0) {
+            throw std::runtime_error("creating the socket failed");
+        }
+        if (connect(_file_descriptor, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            ::close(_file_descriptor);
+            throw std::runtime_error("connecting to '" + path + "' failed");
+        }
+    }
+    compositor_client(const compositor_client&) = delete;
+    compositor_client(compositor_client&& other) = delete;
+    compositor_client& operator=(const compositor_client&) = delete;
+    compositor_client& operator=(compositor_client&& other) = delete;
+    virtual ~compositor_client() {
+        ::close(_file_descriptor);
+    }
+
+    /// set_geometry moves, resizes or restacks the layer.
+    void set_geometry(const layer_geometry& geometry) {
+        compositor_message message{};
+        message.type = compositor_message_type::geometry;
+        message.blend = static_cast<uint8_t>(geometry.blend);
+        message.visible = geometry.visible ? 1 : 0;
+        message.x = geometry.x;
+        message.y = geometry.y;
+        message.width = geometry.width;
+        message.height = geometry.height;
+        message.z = geometry.z;
+        write_all(&message, sizeof(message));
+        _width = geometry.width;
+        _height = geometry.height;
+    }
+
+    /// send_pixels replaces the layer's pixels (layer_stride(width) * height bytes).
+    void send_pixels(const uint8_t* pixels) {
+        compositor_message message{};
+        message.type = compositor_message_type::pixels;
+        message.size = layer_stride(_width) * _height;
+        write_all(&message, sizeof(message));
+        write_all(pixels, message.size);
+    }
+
+    protected:
+    /// write_all writes size bytes to the socket, or throws.
+    void write_all(const void* data, std::size_t size) {
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        while (size > 0) {
+            const auto written = ::send(_file_descriptor, bytes, size, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                throw std::runtime_error("writing to the compositor failed");
+            }
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    int32_t _file_descriptor;
+    uint16_t _width;
+    uint16_t _height;
+};
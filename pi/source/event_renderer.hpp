@@ -0,0 +1,216 @@
+#pragma once
+
+#include "grayscale_packer.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/// event_record_size is the number of bytes of an event in a stream.
+/// Events are packed little-endian records: t (uint64, microseconds), x (uint16), y (uint16) and on (uint8, the
+/// polarity), hence a numpy array with the dtype [("t", "<u8"), ("x", "<u2"), ("y", "<u2"), ("on", "?")] can be
+/// written as is. The origin is the sensor's top-left pixel, and timestamps must be monotonic.
+constexpr std::size_t event_record_size = 13;
+
+/// event_polarity selects the rendered events.
+enum class event_polarity {
+    /// both renders all the events.
+    both,
+
+    /// on renders the events with a brightness increase.
+    on,
+
+    /// off renders the events with a brightness decrease.
+    off,
+};
+
+/// event_rendering selects the conversion from the timestamp of the last event of a pixel to its level.
+enum class event_rendering {
+    /// window lights the pixels that received an event during the last time_constant microseconds.
+    window,
+
+    /// decay sets the level of a pixel to 255 * exp(-age / time_constant), then packs the levels with a dithering
+    /// method.
+    decay,
+};
+
+/// event_renderer converts an address event stream to packed frames.
+/// Events update a timestamp surface with one entry per display pixel (row major, 8 bytes per pixel, 64 kB for 16
+/// panels), so the random writes of a burst hit the L1 or L2 cache. Sensor coordinates are mapped to display pixels
+/// with lookup tables (nearest neighbour scaling). A frame is rendered whenever the event time crosses a multiple of
+/// the frame period (see advance), with a single pass over the surface and a lookup table from age to level.
+/// The renderer processes batches of records in place and does not allocate memory after construction.
+class event_renderer {
+    public:
+    event_renderer(
+        uint8_t width,
+        uint8_t height,
+        uint16_t sensor_width,
+        uint16_t sensor_height,
+        event_rendering rendering,
+        uint64_t time_constant,
+        event_polarity polarity = event_polarity::both,
+        uint64_t frame_period = 9984,
+        dithering method = dithering::ordered) :
+        _sensor_width(sensor_width),
+        _sensor_height(sensor_height),
+        _polarity(polarity),
+        _frame_period(frame_period),
+        _range(rendering == event_rendering::decay ? decay_range * time_constant : time_constant),
+        _columns(sensor_width),
+        _rows(sensor_height),
+        _surface(512 * width * height, 0),
+        _levels(512 * width * height),
+        _frame(64 * width * height + 1, 255),
+        _packer(32 * width, 16 * height, rendering == event_rendering::decay ? method : dithering::threshold),
+        _started(false),
+        _next_frame(0),
+        _time(0),
+        _events(0),
+        _frames(0) {
+        if (width == 0 || height == 0) {
+            throw std::logic_error("width and height must be larger than 0");
+        }
+        if (sensor_width == 0 || sensor_height == 0) {
+            throw std::logic_error("the sensor width and height must be larger than 0");
+        }
+        if (time_constant == 0 || time_constant > maximum_time_constant) {
+            throw std::logic_error("the time constant must be in the range [1, 60000000] us");
+        }
+        if (frame_period == 0) {
+            throw std::logic_error("the frame period must be larger than 0");
+        }
+        for (uint16_t x = 0; x < sensor_width; ++x) {
+            _columns[x] = static_cast<uint16_t>(static_cast<uint32_t>(x) * 32 * width / sensor_width);
+        }
+        for (uint16_t y = 0; y < sensor_height; ++y) {
+            _rows[y] = static_cast<uint32_t>(y) * 16 * height / sensor_height * 32 * width;
+        }
+        for (std::size_t index = 0; index <= table_size; ++index) {
+            if (rendering == event_rendering::window) {
+                _table[index] = 255;
+            } else {
+                // index is proportional to the time left before the pixel expires
+                const auto age = static_cast<double>(table_size - index) / table_size * decay_range;
+                _table[index] = static_cast<uint8_t>(std::lround(255.0 * std::exp(-age)));
+            }
+        }
+        _scale = (static_cast<uint64_t>(table_size) << 32) / _range;
+    }
+    event_renderer(const event_renderer&) = delete;
+    event_renderer(event_renderer&& other) = delete;
+    event_renderer& operator=(const event_renderer&) = delete;
+    event_renderer& operator=(event_renderer&& other) = delete;
+    virtual ~event_renderer() {}
+
+    /// set_brightness changes the brightness byte of the rendered frames.
+    void set_brightness(uint8_t brightness) {
+        _frame[0] = brightness;
+    }
+
+    /// process applies count events stored in records (count * event_record_size bytes).
+    /// handle_frame is called with a pointer to a frame (brightness, then width * height * 64 packed bytes, see
+    /// led_panel::send) whenever the event time crosses a frame boundary, before the events that follow the boundary
+    /// are applied. The pointer is valid until the next frame is rendered.
+    template <typename HandleFrame>
+    void process(const uint8_t* records, std::size_t count, HandleFrame handle_frame) {
+        for (std::size_t index = 0; index < count; ++index) {
+            const auto record = records + index * event_record_size;
+            uint64_t t;
+            uint16_t x;
+            uint16_t y;
+            std::memcpy(&t, record, sizeof(t));
+            std::memcpy(&x, record + 8, sizeof(x));
+            std::memcpy(&y, record + 10, sizeof(y));
+            advance(t, handle_frame);
+            if (x < _sensor_width && y < _sensor_height
+                && (_polarity == event_polarity::both || (record[12] != 0) == (_polarity == event_polarity::on))) {
+                _surface[_rows[y] + _columns[x]] = t + _range;
+            }
+        }
+        _events += count;
+    }
+
+    /// advance renders the frames whose boundaries are at or before t, as process does for an event at time t.
+    /// Call it when no event arrives (with a time derived from the wall clock), so that lit pixels expire on time.
+    /// If every pixel expired before t, a single expired frame is rendered at the last boundary instead of one frame
+    /// per boundary, hence the display does not fall behind after a quiet period.
+    template <typename HandleFrame>
+    void advance(uint64_t t, HandleFrame handle_frame) {
+        _time = std::max(_time, t);
+        if (!_started) {
+            _started = true;
+            _next_frame = t + _frame_period;
+            return;
+        }
+        if (t < _next_frame) {
+            return;
+        }
+        if (t - _next_frame >= _range + _frame_period) {
+            // the events applied so far are older than _next_frame, hence they expire before the last boundary
+            _next_frame += (t - _next_frame) / _frame_period * _frame_period;
+        }
+        for (; t >= _next_frame; _next_frame += _frame_period) {
+            render(_next_frame);
+            handle_frame(static_cast<const uint8_t*>(_frame.data()));
+        }
+    }
+
+    /// time returns the largest time passed to advance (the last event's time if advance was not called directly).
+    uint64_t time() const {
+        return _time;
+    }
+
+    /// events returns the number of processed events, including the filtered ones.
+    uint64_t events() const {
+        return _events;
+    }
+
+    /// frames returns the number of rendered frames.
+    uint64_t frames() const {
+        return _frames;
+    }
+
+    protected:
+    /// table_size is the number of entries of the level lookup table.
+    static constexpr std::size_t table_size = 1024;
+
+    /// decay_range is the age (in time constants) after which a decaying pixel is off (255 * exp(-6) < 1).
+    static constexpr uint64_t decay_range = 6;
+
+    /// maximum_time_constant is the largest time constant in microseconds (60 s).
+    static constexpr uint64_t maximum_time_constant = 60000000;
+
+    /// render converts the surface to levels at the given time, and packs them.
+    /// The surface stores the time at which each pixel expires, hence never updated pixels (0) are off.
+    void render(uint64_t now) {
+        for (std::size_t index = 0; index < _surface.size(); ++index) {
+            const auto expiry = _surface[index];
+            _levels[index] = expiry > now ? _table[((expiry - now) * _scale) >> 32] : 0;
+        }
+        _packer.pack(_levels.data(), _frame.data() + 1);
+        ++_frames;
+    }
+
+    const uint16_t _sensor_width;
+    const uint16_t _sensor_height;
+    const event_polarity _polarity;
+    const uint64_t _frame_period;
+    const uint64_t _range;
+    std::vector<uint16_t> _columns;
+    std::vector<uint32_t> _rows;
+    std::vector<uint64_t> _surface;
+    std::vector<uint8_t> _levels;
+    std::vector<uint8_t> _frame;
+    grayscale_packer _packer;
+    std::array<uint8_t, table_size + 1> _table;
+    uint64_t _scale;
+    bool _started;
+    uint64_t _next_frame;
+    uint64_t _time;
+    uint64_t _events;
+    uint64_t _frames;
+};
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/// dithering selects the grayscale to black and white conversion.
+enum class dithering {
+    /// threshold turns on the pixels whose level is larger than or equal to the threshold.
+    threshold,
+
+    /// ordered compares the levels with an 8 x 8 Bayer matrix.
+    ordered,
+
+    /// error_diffusion propagates the quantization error to the neighbouring pixels (Floyd-Steinberg).
+    error_diffusion,
+};
+
+/// instruction_set selects the implementation of the packing kernel.
+enum class instruction_set {
+    /// scalar is the portable reference implementation.
+    scalar,
+
+    /// sse compares and packs 16 pixels per iteration (x86, requires SSSE3).
+    sse,
+
+    /// avx2 compares and packs 32 pixels per iteration (x86).
+    avx2,
+
+    /// neon compares and packs 16 pixels per iteration (ARM, Raspberry Pi).
+    neon,
+};
+
+/// instruction_set_name returns a printable name.
+inline std::string instruction_set_name(instruction_set set) {
+    switch (set) {
+        case instruction_set::scalar:
+            return "scalar";
+        case instruction_set::sse:
+            return "sse";
+        case instruction_set::avx2:
+            return "avx2";
+        case instruction_set::neon:
+            return "neon";
+    }
+    return "unknown";
+}
+
+/// instruction_set_supported returns true if the instruction set was compiled in and is supported by the CPU.
+inline bool instruction_set_supported(instruction_set set) {
+    switch (set) {
+        case instruction_set::scalar:
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        case instruction_set::sse:
+            return __builtin_cpu_supports("ssse3");
+        case instruction_set::avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+        case instruction_set::neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+/// best_instruction_set returns the fastest supported instruction set.
+inline instruction_set best_instruction_set() {
+    for (const auto set : {instruction_set::avx2, instruction_set::neon, instruction_set::sse}) {
+        if (instruction_set_supported(set)) {
+            return set;
+        }
+    }
+    return instruction_set::scalar;
+}
+
+/// bayer_matrix is the 8 x 8 ordered dithering matrix, with values in the range [0, 64[.
+constexpr std::array<uint8_t, 64> bayer_matrix = {
+    0,  32, 8,  40, 2,  34, 10, 42, 48, 16, 56, 24, 50, 18, 58, 26, 12, 44, 4,  36, 14, 46,
+    6,  38, 60, 28, 52, 20, 62, 30, 54, 22, 3,  35, 11, 43, 1,  33, 9,  41, 51, 19, 59, 27,
+    49, 17, 57, 25, 15, 47, 7,  39, 13, 45, 5,  37, 63, 31, 55, 23, 61, 29, 53, 21};
+
+/// pack_row_scalar packs a row of grayscale pixels, MSB first.
+/// A pixel is on if its level is larger than or equal to thresholds[column % 8]. width must be a multiple of 8.
+/// The SIMD kernels below must produce the same bytes, and fall back to this function for the end of the row.
+inline void pack_row_scalar(const uint8_t* grayscale, const uint8_t* thresholds, uint8_t* packed, uint16_t width) {
+    for (uint16_t column = 0; column < width; column += 8) {
+        uint8_t byte = 0;
+        for (uint8_t bit = 0; bit < 8; ++bit) {
+            byte |= static_cast<uint8_t>((grayscale[column + bit] >= thresholds[bit] ? 0x80 : 0) >> bit);
+        }
+        packed[column / 8] = byte;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/// pack_row_sse is the SSSE3 version of pack_row_scalar.
+/// movemask collects the bytes' MSBs LSB first, hence each group of 8 comparisons is reversed beforehand.
+__attribute__((target("ssse3"))) inline void
+pack_row_sse(const uint8_t* grayscale, const uint8_t* thresholds, uint8_t* packed, uint16_t width) {
+    const auto threshold = _mm_unpacklo_epi64(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(thresholds)),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(thresholds)));
+    const auto reverse = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    uint16_t column = 0;
+    for (; column + 16 <= width; column += 16) {
+        const auto levels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(grayscale + column));
+        const auto on = _mm_cmpeq_epi8(_mm_max_epu8(levels, threshold), levels);
+        const auto bits = static_cast<uint16_t>(_mm_movemask_epi8(_mm_shuffle_epi8(on, reverse)));
+        packed[column / 8] = static_cast<uint8_t>(bits);
+        packed[column / 8 + 1] = static_cast<uint8_t>(bits >> 8);
+    }
+    pack_row_scalar(grayscale + column, thresholds, packed + column / 8, width - column);
+}
+
+/// pack_row_avx2 is the AVX2 version of pack_row_scalar.
+__attribute__((target("avx2"))) inline void
+pack_row_avx2(const uint8_t* grayscale, const uint8_t* thresholds, uint8_t* packed, uint16_t width) {
+    uint64_t thresholds_word;
+    std::memcpy(&thresholds_word, thresholds, sizeof(thresholds_word));
+    const auto threshold = _mm256_set1_epi64x(static_cast<int64_t>(thresholds_word));
+    const auto reverse = _mm256_set_epi8(
+        8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    uint16_t column = 0;
+    for (; column + 32 <= width; column += 32) {
+        const auto levels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(grayscale + column));
+        const auto on = _mm256_cmpeq_epi8(_mm256_max_epu8(levels, threshold), levels);
+        const auto bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_shuffle_epi8(on, reverse)));
+        for (uint8_t byte = 0; byte < 4; ++byte) {
+            packed[column / 8 + byte] = static_cast<uint8_t>(bits >> (8 * byte));
+        }
+    }
+    pack_row_sse(grayscale + column, thresholds, packed + column / 8, width - column);
+}
+#endif
+
+#if defined(__ARM_NEON)
+/// pack_row_neon is the NEON version of pack_row_scalar.
+/// The comparison masks are weighted by bit position, then three pairwise additions sum each group of 8 weights.
+inline void pack_row_neon(const uint8_t* grayscale, const uint8_t* thresholds, uint8_t* packed, uint16_t width) {
+    static const uint8_t weights_values[16] = {128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1};
+    const auto weights = vld1q_u8(weights_values);
+    const auto threshold = vcombine_u8(vld1_u8(thresholds), vld1_u8(thresholds));
+    uint16_t column = 0;
+    for (; column + 16 <= width; column += 16) {
+        const auto on = vcgeq_u8(vld1q_u8(grayscale + column), threshold);
+        const auto bits = vandq_u8(on, weights);
+        auto sums = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+        sums = vpadd_u8(sums, sums);
+        sums = vpadd_u8(sums, sums);
+        packed[column / 8] = vget_lane_u8(sums, 0);
+        packed[column / 8 + 1] = vget_lane_u8(sums, 1);
+    }
+    pack_row_scalar(grayscale + column, thresholds, packed + column / 8, width - column);
+}
+#endif
+
+/// grayscale_packer converts 8 bits grayscale frames to the packed frames expected by led_panel::send.
+/// Grayscale frames are row major, with one byte per pixel. Packed frames are row major, with 8 pixels per byte (the
+/// leftmost pixel is encoded by the most significant bit). width and height are a number of pixels.
+/// The threshold and ordered methods use the given instruction set. Error diffusion is sequential (each pixel depends
+/// on its left neighbour), hence it always runs the scalar implementation. threshold is ignored by the ordered method.
+class grayscale_packer {
+    public:
+    grayscale_packer(
+        uint16_t width,
+        uint16_t height,
+        dithering method = dithering::ordered,
+        uint8_t threshold = 128,
+        instruction_set set = best_instruction_set()) :
+        _width(width),
+        _height(height),
+        _method(method),
+        _threshold(threshold),
+        _set(set),
+        _errors(method == dithering::error_diffusion ? 2 * (width + 2) : 0) {
+        if (_width == 0 || _width % 8 != 0) {
+            throw std::logic_error("width must be a non-zero multiple of 8");
+        }
+        if (!instruction_set_supported(_set)) {
+            throw std::logic_error("the instruction set '" + instruction_set_name(_set) + "' is not supported");
+        }
+        for (uint8_t index = 0; index < 64; ++index) {
+            _thresholds[index] =
+                _method == dithering::ordered ? static_cast<uint8_t>(bayer_matrix[index] * 4 + 2) : _threshold;
+        }
+    }
+    grayscale_packer(const grayscale_packer&) = delete;
+    grayscale_packer(grayscale_packer&& other) = delete;
+    grayscale_packer& operator=(const grayscale_packer&) = delete;
+    grayscale_packer& operator=(grayscale_packer&& other) = delete;
+    virtual ~grayscale_packer() {}
+
+    /// width returns the number of horizontal pixels.
+    uint16_t width() const {
+        return _width;
+    }
+
+    /// height returns the number of vertical pixels.
+    uint16_t height() const {
+        return _height;
+    }
+
+    /// set returns the instruction set used by the threshold and ordered methods.
+    instruction_set set() const {
+        return _set;
+    }
+
+    /// pack converts a grayscale frame (width * height bytes) to a packed frame (width * height / 8 bytes).
+    void pack(const uint8_t* grayscale, uint8_t* packed) {
+        if (_method == dithering::error_diffusion) {
+            diffuse(grayscale, packed);
+            return;
+        }
+        for (uint16_t row = 0; row < _height; ++row) {
+            const auto thresholds = _thresholds.data() + (row % 8) * 8;
+            const auto row_grayscale = grayscale + static_cast<std::size_t>(row) * _width;
+            const auto row_packed = packed + static_cast<std::size_t>(row) * (_width / 8);
+            switch (_set) {
+#if defined(__x86_64__) || defined(__i386__)
+                case instruction_set::sse:
+                    pack_row_sse(row_grayscale, thresholds, row_packed, _width);
+                    break;
+                case instruction_set::avx2:
+                    pack_row_avx2(row_grayscale, thresholds, row_packed, _width);
+                    break;
+#endif
+#if defined(__ARM_NEON)
+                case instruction_set::neon:
+                    pack_row_neon(row_grayscale, thresholds, row_packed, _width);
+                    break;
+#endif
+                default:
+                    pack_row_scalar(row_grayscale, thresholds, row_packed, _width);
+                    break;
+            }
+        }
+    }
+
+    protected:
+    /// diffuse implements Floyd-Steinberg error diffusion.
+    /// _errors holds the errors accumulated for the current and next rows, with a padding element on each side.
+    void diffuse(const uint8_t* grayscale, uint8_t* packed) {
+        std::fill(_errors.begin(), _errors.end(), 0);
+        auto current = _errors.data();
+        auto next = _errors.data() + _width + 2;
+        for (uint16_t row = 0; row < _height; ++row) {
+            for (uint16_t column = 0; column < _width; column += 8) {
+                uint8_t byte = 0;
+                for (uint8_t bit = 0; bit < 8; ++bit) {
+                    const auto index = column + bit;
+                    const int32_t level =
+                        grayscale[static_cast<std::size_t>(row) * _width + index] + current[index + 1];
+                    const auto on = level >= _threshold;
+                    const auto error = level - (on ? 255 : 0);
+                    current[index + 2] += static_cast<int16_t>(error * 7 / 16);
+                    next[index] += static_cast<int16_t>(error * 3 / 16);
+                    next[index + 1] += static_cast<int16_t>(error * 5 / 16);
+                    next[index + 2] += static_cast<int16_t>(error / 16);
+                    byte |= static_cast<uint8_t>((on ? 0x80 : 0) >> bit);
+                }
+                packed[(static_cast<std::size_t>(row) * _width + column) / 8] = byte;
+            }
+            std::swap(current, next);
+            std::fill(next, next + _width + 2, 0);
+        }
+    }
+
+    const uint16_t _width;
+    const uint16_t _height;
+    const dithering _method;
+    const uint8_t _threshold;
+    const instruction_set _set;
+    std::array<uint8_t, 64> _thresholds;
+    std::vector<int16_t> _errors;
+};
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#ifndef LED_PANEL_INSTRUMENTATION
+#define LED_PANEL_INSTRUMENTATION 0
+#endif
+
+/// instrumentation_enabled is true if led_panel collects counters and histograms.
+/// Compile with -DLED_PANEL_INSTRUMENTATION=1 to enable it. Otherwise, the instrumentation code is discarded at compile
+/// time and snapshots are zero-filled.
+constexpr bool instrumentation_enabled = LED_PANEL_INSTRUMENTATION != 0;
+
+/// histogram_buckets is the number of latency histogram buckets.
+/// Bucket i counts the durations in the range [2^i, 2^(i + 1)[ ns (bucket 0 also counts zero durations).
+constexpr std::size_t histogram_buckets = 40;
+
+/// histogram_snapshot is a copy of a latency_histogram.
+struct histogram_snapshot {
+    /// buckets counts the recorded durations, with power-of-two bounds.
+    std::array<uint64_t, histogram_buckets> buckets;
+
+    /// count is the number of recorded durations.
+    uint64_t count;
+
+    /// sum is the total of the recorded durations, in nanoseconds.
+    uint64_t sum;
+
+    /// maximum is the largest recorded duration, in nanoseconds.
+    uint64_t maximum;
+
+    /// mean returns the average duration in nanoseconds, or 0 if the histogram is empty.
+    double mean() const {
+        return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+    }
+
+    /// percentile returns an upper bound of the duration at the given rank (in the range [0, 1]), in nanoseconds.
+    uint64_t percentile(double rank) const {
+        if (count == 0) {
+            return 0;
+        }
+        const auto target = static_cast<uint64_t>(rank * (count - 1)) + 1;
+        uint64_t total = 0;
+        for (std::size_t bucket = 0; bucket < histogram_buckets; ++bucket) {
+            total += buckets[bucket];
+            if (total >= target) {
+                return std::min<uint64_t>((uint64_t(2) << bucket) - 1, maximum);
+            }
+        }
+        return maximum;
+    }
+};
+
+/// latency_histogram records durations in power-of-two buckets.
+/// record must be called by a single thread. snapshot may be called concurrently by any thread, it is lock-free but a
+/// snapshot taken during a record may miss it in some fields.
+class latency_histogram {
+    public:
+    latency_histogram() : _count(0), _sum(0), _maximum(0) {
+        for (auto& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram(latency_histogram&& other) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+    latency_histogram& operator=(latency_histogram&& other) = delete;
+    virtual ~latency_histogram() {}
+
+    /// record adds a duration to the histogram.
+    void record(std::chrono::nanoseconds duration) {
+        const auto value = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+        const auto bucket = std::min<std::size_t>(
+            value == 0 ? 0 : 63 - static_cast<std::size_t>(__builtin_clzll(value)), histogram_buckets - 1);
+        increment(_buckets[bucket], 1);
+        increment(_count, 1);
+        increment(_sum, value);
+        if (value > _maximum.load(std::memory_order_relaxed)) {
+            _maximum.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /// snapshot copies the histogram.
+    histogram_snapshot snapshot() const {
+        histogram_snapshot result;
+        for (std::size_t bucket = 0; bucket < histogram_buckets; ++bucket) {
+            result.buckets[bucket] = _buckets[bucket].load(std::memory_order_relaxed);
+        }
+        result.count = _count.load(std::memory_order_relaxed);
+        result.sum = _sum.load(std::memory_order_relaxed);
+        result.maximum = _maximum.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    /// increment adds a value to a counter that has a single writer (cheaper than fetch_add).
+    static void increment(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    protected:
+    std::array<std::atomic<uint64_t>, histogram_buckets> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _maximum;
+};
+
+/// instrumentation_snapshot is a copy of led_panel's counters and histograms.
+struct instrumentation_snapshot {
+    /// time is the snapshot's steady clock time, used to calculate rates between snapshots.
+    std::chrono::steady_clock::time_point time;
+
+    /// frames is the number of transmitted frames (and planes).
+    uint64_t frames;
+
+    /// bytes is the number of transmitted bytes, including the brightness and trailer bytes.
+    uint64_t bytes;
+
+    /// skipped is the number of frames skipped by unchanged-frame suppression.
+    uint64_t skipped;
+
+    /// fallback_sleeps is the number of first bytes that were not acknowledged after 100 us, which made send sleep
+    /// until 15 ms after the previous frame (the firmware's frame buffer was full).
+    uint64_t fallback_sleeps;
+
+    /// acknowledge_timeouts is the number of bytes that were not acknowledged before the acknowledge timeout.
+    uint64_t acknowledge_timeouts;
+
+    /// stalls is the number of acknowledge waits longer than 8 display periods. The firmware resets a transfer that
+    /// stalls for this long (frame_tick timeout), hence each stall most likely corresponds to a reset.
+    uint64_t stalls;
+
+    /// recoveries is the number of acknowledge timeouts followed by a resync and a new transfer of the frame.
+    uint64_t recoveries;
+
+    /// transfer is the duration of frame transfers, from the first pixel byte to the trailer byte.
+    histogram_snapshot transfer;
+
+    /// jitter is the excess duration of frame transfers over the fastest observed byte rate, caused by preemptions,
+    /// interrupts and page faults during the transfer.
+    histogram_snapshot jitter;
+
+    /// first_byte is the duration of the brightness byte handshake, which waits for a free frame buffer slot.
+    histogram_snapshot first_byte;
+
+    /// acknowledge_wait is the duration of the acknowledge spin loop of pixel and trailer bytes.
+    histogram_snapshot acknowledge_wait;
+
+    /// input_wait is the time spent waiting for input frames, recorded by the application (for instance the sink).
+    histogram_snapshot input_wait;
+
+    /// presentation is the estimated delay between the brightness byte of a frame (or plane group) and its display
+    /// (see presentation_time in led_panel.hpp).
+    histogram_snapshot presentation;
+};
+
+/// basic_instrumentation holds led_panel's counters and histograms.
+/// Each counter and histogram must have a single writer (the sending thread, or the input thread for input_wait).
+/// snapshot is lock-free and may be called from any thread.
+template <bool Enabled>
+class basic_instrumentation {
+    public:
+    basic_instrumentation() :
+        _frames(0),
+        _bytes(0),
+        _skipped(0),
+        _fallback_sleeps(0),
+        _acknowledge_timeouts(0),
+        _stalls(0),
+        _recoveries(0) {}
+    basic_instrumentation(const basic_instrumentation&) = delete;
+    basic_instrumentation(basic_instrumentation&& other) = delete;
+    basic_instrumentation& operator=(const basic_instrumentation&) = delete;
+    basic_instrumentation& operator=(basic_instrumentation&& other) = delete;
+    virtual ~basic_instrumentation() {}
+
+    /// count_frame counts a transmitted frame of the given number of bytes.
+    void count_frame(uint64_t bytes) {
+        latency_histogram::increment(_frames, 1);
+        latency_histogram::increment(_bytes, bytes);
+    }
+
+    /// count_skipped counts a frame skipped by unchanged-frame suppression.
+    void count_skipped() {
+        latency_histogram::increment(_skipped, 1);
+    }
+
+    /// count_fallback_sleep counts a first byte that required the 15 ms sleep.
+    void count_fallback_sleep() {
+        latency_histogram::increment(_fallback_sleeps, 1);
+    }
+
+    /// count_acknowledge_timeout counts an acknowledge timeout.
+    void count_acknowledge_timeout() {
+        latency_histogram::increment(_acknowledge_timeouts, 1);
+    }
+
+    /// count_stall counts an acknowledge wait longer than 8 display periods.
+    void count_stall() {
+        latency_histogram::increment(_stalls, 1);
+    }
+
+    /// count_recovery counts an acknowledge timeout recovered by resync.
+    void count_recovery() {
+        latency_histogram::increment(_recoveries, 1);
+    }
+
+    /// record_transfer records the duration of a frame transfer (pixel bytes and trailer byte).
+    void record_transfer(std::chrono::nanoseconds duration) {
+        _transfer.record(duration);
+    }
+
+    /// record_jitter records the excess duration of a frame transfer.
+    void record_jitter(std::chrono::nanoseconds duration) {
+        _jitter.record(duration);
+    }
+
+    /// record_first_byte records the duration of a brightness byte handshake.
+    void record_first_byte(std::chrono::nanoseconds duration) {
+        _first_byte.record(duration);
+    }
+
+    /// record_acknowledge_wait records the duration of an acknowledge spin loop.
+    void record_acknowledge_wait(std::chrono::nanoseconds duration) {
+        _acknowledge_wait.record(duration);
+    }
+
+    /// record_input_wait records the time spent waiting for an input frame.
+    void record_input_wait(std::chrono::nanoseconds duration) {
+        _input_wait.record(duration);
+    }
+
+    /// record_presentation records the estimated delay between a brightness byte and the display of its frame.
+    void record_presentation(std::chrono::nanoseconds duration) {
+        _presentation.record(duration);
+    }
+
+    /// snapshot copies the counters and histograms.
+    instrumentation_snapshot snapshot() const {
+        return {
+            std::chrono::steady_clock::now(),
+            _frames.load(std::memory_order_relaxed),
+            _bytes.load(std::memory_order_relaxed),
+            _skipped.load(std::memory_order_relaxed),
+            _fallback_sleeps.load(std::memory_order_relaxed),
+            _acknowledge_timeouts.load(std::memory_order_relaxed),
+            _stalls.load(std::memory_order_relaxed),
+            _recoveries.load(std::memory_order_relaxed),
+            _transfer.snapshot(),
+            _jitter.snapshot(),
+            _first_byte.snapshot(),
+            _acknowledge_wait.snapshot(),
+            _input_wait.snapshot(),
+            _presentation.snapshot(),
+        };
+    }
+
+    protected:
+    std::atomic<uint64_t> _frames;
+    std::atomic<uint64_t> _bytes;
+    std::atomic<uint64_t> _skipped;
+    std::atomic<uint64_t> _fallback_sleeps;
+    std::atomic<uint64_t> _acknowledge_timeouts;
+    std::atomic<uint64_t> _stalls;
+    std::atomic<uint64_t> _recoveries;
+    latency_histogram _transfer;
+    latency_histogram _jitter;
+    latency_histogram _first_byte;
+    latency_histogram _acknowledge_wait;
+    latency_histogram _input_wait;
+    latency_histogram _presentation;
+};
+
+/// basic_instrumentation<false> is an empty implementation, whose functions compile to nothing.
+template <>
+class basic_instrumentation<false> {
+    public:
+    void count_frame(uint64_t) {}
+    void count_skipped() {}
+    void count_fallback_sleep() {}
+    void count_acknowledge_timeout() {}
+    void count_stall() {}
+    void count_recovery() {}
+    void record_transfer(std::chrono::nanoseconds) {}
+    void record_jitter(std::chrono::nanoseconds) {}
+    void record_first_byte(std::chrono::nanoseconds) {}
+    void record_acknowledge_wait(std::chrono::nanoseconds) {}
+    void record_input_wait(std::chrono::nanoseconds) {}
+    void record_presentation(std::chrono::nanoseconds) {}
+    instrumentation_snapshot snapshot() const {
+        return instrumentation_snapshot{};
+    }
+};
+
+/// led_panel_instrumentation is the implementation selected by LED_PANEL_INSTRUMENTATION.
+using led_panel_instrumentation = basic_instrumentation<instrumentation_enabled>;
+
+/// instrumentation_to_text formats a snapshot as a human-readable line.
+/// Rates (frames per second) are calculated over the interval between previous and current.
+inline std::string
+instrumentation_to_text(const instrumentation_snapshot& current, const instrumentation_snapshot& previous) {
+    const auto interval = std::chrono::duration<double>(current.time - previous.time).count();
+    const auto fps = interval > 0 ? (current.frames - previous.frames) / interval : 0.0;
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1) << "fps " << fps
+           << ", frames " << current.frames << ", skipped " << current.skipped << ", fallback sleeps "
+           << current.fallback_sleeps << ", acknowledge timeouts " << current.acknowledge_timeouts << ", stalls "
+           << current.stalls << ", recoveries " << current.recoveries;
+    const std::array<std::pair<const char*, const histogram_snapshot*>, 6> histograms = {{
+        {"transfer", &current.transfer},
+        {"jitter", &current.jitter},
+        {"first byte", &current.first_byte},
+        {"acknowledge wait", &current.acknowledge_wait},
+        {"input wait", &current.input_wait},
+        {"presentation", &current.presentation},
+    }};
+    for (const auto& histogram : histograms) {
+        stream << ", " << histogram.first << " (us) mean " << histogram.second->mean() / 1e3 << " p50 "
+               << histogram.second->percentile(0.5) / 1e3 << " p99 " << histogram.second->percentile(0.99) / 1e3
+               << " max " << histogram.second->maximum / 1e3;
+    }
+    return stream.str();
+}
+
+/// instrumentation_to_json formats a snapshot as a single-line JSON object.
+/// Durations are in nanoseconds, histogram buckets are listed in increasing order of bounds.
+inline std::string
+instrumentation_to_json(const instrumentation_snapshot& current, const instrumentation_snapshot& previous) {
+    const auto interval = std::chrono::duration<double>(current.time - previous.time).count();
+    const auto fps = interval > 0 ? (current.frames - previous.frames) / interval : 0.0;
+    std::ostringstream stream;
+    stream << "{\"fps\":" << fps << ",\"frames\":" << current.frames
+           << ",\"bytes\":" << current.bytes << ",\"skipped\":" << current.skipped
+           << ",\"fallback_sleeps\":" << current.fallback_sleeps
+           << ",\"acknowledge_timeouts\":" << current.acknowledge_timeouts << ",\"stalls\":" << current.stalls
+           << ",\"recoveries\":" << current.recoveries;
+    const std::array<std::pair<const char*, const histogram_snapshot*>, 6> histograms = {{
+        {"transfer", &current.transfer},
+        {"jitter", &current.jitter},
+        {"first_byte", &current.first_byte},
+        {"acknowledge_wait", &current.acknowledge_wait},
+        {"input_wait", &current.input_wait},
+        {"presentation", &current.presentation},
+    }};
+    for (const auto& histogram : histograms) {
+        stream << ",\"" << histogram.first << "\":{\"count\":" << histogram.second->count
+               << ",\"sum\":" << histogram.second->sum << ",\"max\":" << histogram.second->maximum
+               << ",\"p50\":" << histogram.second->percentile(0.5) << ",\"p99\":" << histogram.second->percentile(0.99)
+               << ",\"buckets\":[";
+        for (std::size_t bucket = 0; bucket < histogram_buckets; ++bucket) {
+            stream << (bucket == 0 ? "" : ",") << histogram.second->buckets[bucket];
+        }
+        stream << "]}";
+    }
+    stream << "}";
+    return stream.str();
+}
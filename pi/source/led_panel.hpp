@@ -1,40 +1,196 @@
 #pragma once
 
+#include "instrumentation.hpp"
+#include "waveform_cache.hpp"
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <cstdint>
 #include <fcntl.h>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <stdexcept>
 #include <sys/mman.h>
 #include <thread>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
-/// led_panel controls the communication with an array of 32 x 16 LED panels.
-/// The constructor's width and height correspond to a number of led_panels, not pixels.
-class led_panel {
+/// gpiomem maps the Raspberry Pi GPIO registers.
+/// A register backend provides write and read functions, whose offset is a 32 bits register index. led_panel only
+/// calls these functions, which makes it possible to replace the hardware with a simulation (see
+/// simulated_arduino.hpp).
+class gpiomem {
     public:
-    led_panel(uint8_t width, uint8_t height) :
-        _width(width), _height(height), _memory_file_descriptor(open("/dev/gpiomem", O_RDWR | O_SYNC)) {
+    gpiomem() : _memory_file_descriptor(open("/dev/gpiomem", O_RDWR | O_SYNC)) {
         if (_memory_file_descriptor < 0) {
             throw std::logic_error("'/dev/gpiomem' could not be opened in read and write mode");
         }
-        auto map = mmap(nullptr, 180, PROT_READ | PROT_WRITE, MAP_SHARED, _memory_file_descriptor, 0);
+        auto map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _memory_file_descriptor, 0);
         if (map == MAP_FAILED) {
             close(_memory_file_descriptor);
             throw std::logic_error("mmap failed");
         }
         _gpios = reinterpret_cast<volatile uint32_t*>(const_cast<volatile void*>(map));
-        //                --999888777666555444333222------
-        *(_gpios + 0) = 0b00000000000001001000000000000000u;
-        //                --999888777666555444333222111000
-        *(_gpios + 1) = 0b00001000000001000000001000000000u;
-        //                --------777666555444333222111000
-        *(_gpios + 2) = 0b00000000001001000000000000001001u;
-        *(_gpios + clear_offset) = _byte_to_mask[255] | request_mask;
+    }
+    gpiomem(const gpiomem&) = delete;
+    gpiomem(gpiomem&& other) : _memory_file_descriptor(other._memory_file_descriptor), _gpios(other._gpios) {
+        other._memory_file_descriptor = -1;
+        other._gpios = nullptr;
+    }
+    gpiomem& operator=(const gpiomem&) = delete;
+    gpiomem& operator=(gpiomem&& other) = delete;
+    ~gpiomem() {
+        if (_gpios != nullptr) {
+            munmap(const_cast<void*>(reinterpret_cast<volatile void*>(_gpios)), size);
+            close(_memory_file_descriptor);
+        }
+    }
+
+    /// write stores a value in the given register.
+    void write(uint8_t offset, uint32_t value) {
+        *(_gpios + offset) = value;
+    }
+
+    /// read loads the value of the given register.
+    uint32_t read(uint8_t offset) {
+        return *(_gpios + offset);
+    }
+
+    protected:
+    /// size is the number of mapped bytes.
+    static constexpr std::size_t size = 180;
+
+    int32_t _memory_file_descriptor;
+    volatile uint32_t* _gpios;
+};
+
+/// display_coordinates_to_frame_index converts a display byte position to a frame index.
+/// The frame must be in row major order.
+///     - width is the number of panels (horizontaly)
+///     - height is the number of panels (verticaly)
+///     - ab is the row block index, in the range [0, 4[
+///     - panel is the s-pattern panel index, in the range [0, width * height[
+///     - column is the column index, in the range [0, 4[
+///     - row is the interlaced row index, in the range [0, 4[
+/// The Arduino is connected to the panel with coordinates (width - 1, height - 1)
+/// Both the panel and pixel coordinates use the conventional frame coordinate system, with the origin at the top
+/// left.
+constexpr uint16_t display_coordinates_to_frame_index(
+    uint8_t width,
+    uint8_t height,
+    uint8_t ab,
+    uint8_t panel,
+    uint8_t row,
+    uint8_t column) {
+    return column + (panel % width) * 4 + ((3 - row) * 4 + ab + (panel / width) * 16) * width * 4;
+}
+
+/// fill_wire_order writes the pixel byte indices in transmission order (wire order) to table.
+/// The indices do not account for the brightness byte, hence table[0] is the index of the first pixel byte in the
+/// packed pixels. table must have width * height * 64 elements.
+template <typename Table>
+constexpr void fill_wire_order(Table& table, uint8_t width, uint8_t height) {
+    uint16_t index = 0;
+    for (uint8_t ab = 0; ab < 4; ++ab) {
+        for (uint8_t panel = 0; panel < width * height; ++panel) {
+            for (uint8_t column = 0; column < 4; ++column) {
+                for (uint8_t row = 0; row < 4; ++row) {
+                    table[index] = display_coordinates_to_frame_index(width, height, ab, panel, row, column);
+                    ++index;
+                }
+            }
+        }
+    }
+}
+
+/// static_wire_order calculates the wire order of a layout known at compile time.
+template <uint8_t Width, uint8_t Height>
+constexpr std::array<uint16_t, 64 * Width * Height> static_wire_order() {
+    std::array<uint16_t, 64 * Width * Height> table{};
+    fill_wire_order(table, Width, Height);
+    return table;
+}
+
+/// dynamic_wire_order calculates the wire order of a layout known at runtime.
+inline std::vector<uint16_t> dynamic_wire_order(uint8_t width, uint8_t height) {
+    std::vector<uint16_t> table(64 * width * height);
+    fill_wire_order(table, width, height);
+    return table;
+}
+
+/// handshake_timing holds the busy-wait delays of a byte transfer, as a number of nop instructions.
+struct handshake_timing {
+    /// setup is the delay between the data pins update and the request edge.
+    uint16_t setup;
+
+    /// hold is the delay between the previous acknowledge edge and the data pins update.
+    uint16_t hold;
+};
+
+/// default_handshake_timing is a conservative timing that works on every Raspberry Pi model.
+constexpr handshake_timing default_handshake_timing = {64, 64};
+
+/// display_period is the firmware's display period (see arduino/arduino.c).
+constexpr std::chrono::nanoseconds display_period = std::chrono::nanoseconds(9984000);
+
+/// recommended_acknowledge_timeout is 5 display periods, which fits the bounds of set_acknowledge_timeout.
+constexpr std::chrono::nanoseconds recommended_acknowledge_timeout = std::chrono::milliseconds(50);
+
+/// dynamic_layout selects a number of panels known at runtime.
+constexpr uint8_t dynamic_layout = 0;
+
+/// led_panel controls the communication with an array of 32 x 16 LED panels.
+/// The constructor's width and height correspond to a number of led_panels, not pixels.
+/// Width and Height may be set to a number of panels at compile time, in which case the wire order is a constant
+/// table. Otherwise (dynamic_layout), the table is calculated by the constructor.
+/// Gpio is the register backend, gpiomem drives the actual hardware.
+/// The constructor transmits 8 blank frames with the given acknowledge timeout and recovery attempts (see
+/// set_acknowledge_timeout), hence a display that does not respond makes it throw instead of waiting forever.
+template <uint8_t Width = dynamic_layout, uint8_t Height = dynamic_layout, typename Gpio = gpiomem>
+class led_panel {
+    static_assert(
+        (Width == dynamic_layout) == (Height == dynamic_layout),
+        "Width and Height must be either both dynamic or both static");
+
+    public:
+    /// dynamic is true if the number of panels is known at runtime.
+    static constexpr bool dynamic = Width == dynamic_layout;
+
+    /// max_buffer_depth is the largest number of frames queued by the firmware behind the displayed one.
+    static constexpr uint8_t max_buffer_depth = 7;
+
+    led_panel(
+        uint8_t width = Width,
+        uint8_t height = Height,
+        Gpio gpio = Gpio(),
+        std::chrono::nanoseconds acknowledge_timeout = std::chrono::nanoseconds(0),
+        uint32_t recovery_attempts = 0) :
+        _width(width),
+        _height(height),
+        _wire_order(dynamic ? dynamic_wire_order(width, height) : std::vector<uint16_t>()),
+        _gpio(std::move(gpio)),
+        _acknowledge_timeout(acknowledge_timeout),
+        _recovery_attempts(recovery_attempts) {
+        if (_width == 0 || _height == 0) {
+            throw std::logic_error("width and height must be larger than 0");
+        }
+        if (!dynamic && (_width != Width || _height != Height)) {
+            throw std::logic_error("width and height do not match the static layout");
+        }
+        //               --999888777666555444333222------
+        _gpio.write(0, 0b00000000000001001000000000000000u);
+        //               --999888777666555444333222111000
+        _gpio.write(1, 0b00001000000001000000001000000000u);
+        //               --------777666555444333222111000
+        _gpio.write(2, 0b00000000001001000000000000001001u);
+        _gpio.write(clear_offset, _byte_to_mask[255] | request_mask);
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        _display_boundary = std::chrono::steady_clock::now();
+        _presentation_times.fill(_display_boundary);
         for (uint8_t index = 0; index < 8; ++index) {
-            send(std::vector<uint8_t>(64 * _width * _height + 1, 0));
+            send(std::vector<uint8_t>(frame_size() + 1, 0));
         }
     }
     led_panel(const led_panel&) = delete;
@@ -42,59 +198,560 @@ class led_panel {
     led_panel& operator=(const led_panel&) = delete;
     led_panel& operator=(led_panel&& other) = delete;
     virtual ~led_panel() {
-        *(_gpios + clear_offset) = _byte_to_mask[255] | request_mask;
-        *(_gpios + 2) = 0u;
-        *(_gpios + 1) = 0u;
-        *(_gpios + 0) = 0u;
-        munmap(const_cast<void*>(reinterpret_cast<volatile void*>(_gpios)), 180);
-        close(_memory_file_descriptor);
+        _gpio.write(clear_offset, _byte_to_mask[255] | request_mask);
+        _gpio.write(2, 0u);
+        _gpio.write(1, 0u);
+        _gpio.write(0, 0u);
+    }
+
+    /// gpio returns the register backend.
+    Gpio& gpio() {
+        return _gpio;
+    }
+
+    /// width returns the number of horizontal panels.
+    uint8_t width() const {
+        return _width;
+    }
+
+    /// height returns the number of vertical panels.
+    uint8_t height() const {
+        return _height;
+    }
+
+    /// frame_size returns the number of pixel bytes in a frame.
+    uint16_t frame_size() const {
+        if constexpr (dynamic) {
+            return 64 * _width * _height;
+        } else {
+            return 64 * Width * Height;
+        }
+    }
+
+    /// timing returns the handshake delays.
+    handshake_timing timing() const {
+        return _timing;
+    }
+
+    /// set_timing changes the handshake delays (see calibration.hpp).
+    void set_timing(handshake_timing timing) {
+        _timing = timing;
+    }
+
+    /// set_acknowledge_timeout bounds the acknowledge wait. send throws a std::runtime_error if the display does not
+    /// acknowledge a byte before the timeout. A zero timeout (the default) waits forever.
+    /// If recovery_attempts is larger than 0, send recovers from timeouts: it calls resync and transmits the frame (or
+    /// plane) again, up to recovery_attempts times before throwing. This survives an Arduino reset or a cable that is
+    /// unplugged and plugged back. The timeout must be longer than the wait for a free frame buffer slot (a display
+    /// period, or 4 with 4 planes temporal grayscale groups), and shorter than the firmware's frame_tick timeout (8
+    /// display periods) to detect a stalled transfer before the firmware gives up on it (see
+    /// recommended_acknowledge_timeout).
+    void set_acknowledge_timeout(std::chrono::nanoseconds timeout, uint32_t recovery_attempts = 0) {
+        _acknowledge_timeout = timeout;
+        _recovery_attempts = recovery_attempts;
+    }
+
+    /// acknowledge_timeout returns the acknowledge timeout (zero if the wait is not bounded).
+    std::chrono::nanoseconds acknowledge_timeout() const {
+        return _acknowledge_timeout;
+    }
+
+    /// recovery_attempts returns the number of resyncs attempted after an acknowledge timeout.
+    uint32_t recovery_attempts() const {
+        return _recovery_attempts;
+    }
+
+    /// set_spin_limit changes how long an acknowledge wait polls the pin in a tight loop (200 us by default). Longer
+    /// waits yield the core between polls, hence a display that stopped responding does not monopolize it. Pixel
+    /// handshakes complete within a few microseconds, only brightness bytes that wait for a free slot yield.
+    void set_spin_limit(std::chrono::nanoseconds spin_limit) {
+        _spin_limit = spin_limit;
+    }
+
+    /// resync recovers from an interrupted transfer.
+    /// It releases the request pin and waits for the firmware's frame_tick timeout.
+    void resync() {
+        _gpio.write(clear_offset, request_mask);
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        _previous_write = std::chrono::high_resolution_clock::now();
+        _delta_next = false;
+        _group_slots = 0;
+    }
+
+    /// send_deltas enables or disables delta transfers.
+    /// When enabled, a transfer only carries the 16-byte blocks (a row block of a panel) that changed since the
+    /// previous transfer, after a bitmap of the changed blocks. This requires the delta-capable firmware. The first
+    /// frame after enabling deltas, after resync, and after more than 7 idle display periods is transmitted in full
+    /// (the firmware leaves delta mode after 8 idle periods). Delta transfers bypass the waveform cache.
+    void send_deltas(bool enabled) {
+        _deltas = enabled;
+    }
+
+    /// set_buffer_depth changes the number of frames (or plane groups) that the firmware may queue behind the
+    /// displayed one, between 1 and max_buffer_depth (the default). The firmware applies it from the next frame on.
+    /// A deep buffer maximizes throughput, but a frame may be displayed up to 7 display periods (70 ms) after send
+    /// returns if the application runs ahead of the display. A shallow buffer (low-latency mode) bounds this delay,
+    /// and send paces transfers against the display period: instead of polling the firmware or sleeping for 15 ms
+    /// when the buffer is full, it sleeps until the display period boundary at which a slot becomes available.
+    /// Depths lower than 7 require the firmware from this repository version (older firmware ignores them).
+    void set_buffer_depth(uint8_t depth) {
+        if (depth == 0 || depth > max_buffer_depth) {
+            throw std::logic_error("the buffer depth must be in the range [1, 7]");
+        }
+        _buffer_depth = depth;
+    }
+
+    /// buffer_depth returns the number of frames that the firmware may queue behind the displayed one.
+    uint8_t buffer_depth() const {
+        return _buffer_depth;
+    }
+
+    /// presentation_time returns the estimated time at which the last transmitted frame (or plane group) is first
+    /// displayed, on the steady clock.
+    /// The estimate assumes that the display moves to the next queued frame at each display period boundary. The
+    /// boundaries are synchronized with the firmware whenever a brightness handshake waits for a free slot, which
+    /// happens when the application keeps the buffer full. Otherwise, the estimate drifts with the Arduino's clock
+    /// accuracy since the last synchronization.
+    std::chrono::steady_clock::time_point presentation_time() const {
+        return _presentation_times[(_presentation_index + 7) % 8];
+    }
+
+    /// skip_unchanged enables or disables unchanged-frame suppression.
+    /// When enabled, send returns immediately if the frame (brightness and pixels) is identical to the previously
+    /// transmitted frame, since the display keeps showing its last frame. A repeated frame is still transmitted if
+    /// keep_alive has elapsed since the previous transmission.
+    void skip_unchanged(bool enabled, std::chrono::milliseconds keep_alive = std::chrono::milliseconds(1000)) {
+        _skip_unchanged = enabled;
+        _keep_alive = keep_alive;
+        _previous_frame.clear();
+    }
+
+    /// cache_waveforms enables the waveform cache (see waveform_cache.hpp), or disables it if capacity is 0.
+    /// Transmitted frames are compiled to GPIO register words in wire order and the last capacity waveforms are kept,
+    /// hence a repeated frame (a looping animation or a static screen) is replayed without byte-to-mask conversions.
+    /// Each waveform uses about 9 bytes per frame byte.
+    void cache_waveforms(std::size_t capacity) {
+        if (capacity == 0) {
+            _waveforms.reset();
+        } else {
+            _waveforms.reset(new waveform_cache(capacity));
+        }
+    }
+
+    /// waveform_statistics returns the waveform cache counters (zero-filled if the cache is disabled).
+    waveform_cache_statistics waveform_statistics() const {
+        return _waveforms ? _waveforms->statistics() : waveform_cache_statistics{};
+    }
+
+    /// sent returns the number of transmitted frames, including the constructor's blank frames.
+    uint64_t sent() const {
+        return _sent;
+    }
+
+    /// skipped returns the number of frames skipped by unchanged-frame suppression.
+    uint64_t skipped() const {
+        return _skipped;
+    }
+
+    /// recoveries returns the number of timeouts recovered by resync (see set_acknowledge_timeout).
+    uint64_t recoveries() const {
+        return _recoveries;
     }
 
     /// send transmits a frame to the led_panel.
     /// The frame must have width * height * 64 bytes.
     virtual void send(const std::vector<uint8_t>& frame) {
-        if (frame.size() != 64 * _width * _height + 1) {
+        if (frame.size() != frame_size() + 1u) {
             throw std::logic_error("bad frame size");
         }
+        send(frame.data());
+    }
+
+    /// send transmits a frame stored in contiguous memory, for instance a shared memory slot.
+    /// frame must point to width * height * 64 + 1 bytes (brightness and pixels).
+    virtual void send(const uint8_t* frame) {
+        send(frame[0], frame + 1);
+    }
+
+    /// send transmits a brightness and packed pixels stored separately, for instance a Python buffer.
+    /// pixels must point to width * height * 64 bytes.
+    virtual void send(uint8_t brightness, const uint8_t* pixels) {
+        if (_skip_unchanged) {
+            if (!_previous_frame.empty() && _previous_frame[0] == brightness
+                && std::equal(std::next(_previous_frame.begin()), _previous_frame.end(), pixels)
+                && std::chrono::high_resolution_clock::now() < _previous_write + _keep_alive) {
+                ++_skipped;
+                _instrumentation.count_skipped();
+                return;
+            }
+        }
+        // the previous frame is updated once the transfer succeeded, hence a failed frame is not skipped on retry
+        _previous_frame.clear();
+        transmit(brightness, pixels, group_end_trailer);
+        if (_skip_unchanged) {
+            _previous_frame.resize(frame_size() + 1);
+            _previous_frame[0] = brightness;
+            std::copy(pixels, pixels + frame_size(), std::next(_previous_frame.begin()));
+        }
+    }
+
+    /// send_plane transmits a bit-plane of a temporal grayscale group (see temporal_grayscale.hpp).
+    /// The firmware displays a group once its last plane has been received, and loops over it until the next group is
+    /// complete. Planes are never skipped by unchanged-frame suppression.
+    void send_plane(uint8_t brightness, const uint8_t* pixels, bool last) {
+        _previous_frame.clear();
+        transmit(brightness, pixels, last ? group_end_trailer : pending_plane_trailer);
+    }
+
+    /// send_wire_ordered transmits pixels that are already in wire order (see fill_wire_order), for instance a clip
+    /// record (see clip.hpp), without permutation. pixels must point to width * height * 64 bytes.
+    /// Wire-ordered frames are never skipped by unchanged-frame suppression, and bypass the waveform cache.
+    void send_wire_ordered(uint8_t brightness, const uint8_t* pixels) {
+        _previous_frame.clear();
+        transmit(brightness, pixels, group_end_trailer, true);
+    }
+
+    /// verify transmits a frame and asks the firmware to echo a checksum of the frame buffer slot that it committed
+    /// (see slot_checksum in arduino/arduino.c). It returns true if the echo matches the transmitted frame, that is, if
+    /// every byte arrived intact. The echo adds 18 echo delays (18 ms) to the transfer. verify requires the
+    /// firmware from this repository version (older firmware does not echo, and verify returns false).
+    bool verify(const std::vector<uint8_t>& frame) {
+        if (frame.size() != frame_size() + 1u) {
+            throw std::logic_error("bad frame size");
+        }
+        _previous_frame.clear();
+        transmit(frame[0], frame.data() + 1, group_end_trailer | checksum_request_trailer);
+        return read_checksum() == checksum(frame);
+    }
+
+    /// transfer_duration returns the duration of the last transmission, from the first pixel byte to the trailer.
+    /// It does not include the brightness byte, which waits for a free frame buffer slot.
+    std::chrono::nanoseconds transfer_duration() const {
+        return _transfer_duration;
+    }
+
+    /// metrics returns the counters and histograms (see instrumentation.hpp).
+    /// Call metrics().snapshot() to read them from any thread. The functions do nothing if LED_PANEL_INSTRUMENTATION
+    /// is not enabled.
+    led_panel_instrumentation& metrics() {
+        return _instrumentation;
+    }
+
+    protected:
+    /// group_end_trailer is the trailer byte of a frame that completes a group (regular frames are groups of one).
+    static constexpr uint8_t group_end_trailer = 0;
+
+    /// pending_plane_trailer is the trailer byte of a plane followed by other planes of the same group.
+    static constexpr uint8_t pending_plane_trailer = 1;
+
+    /// checksum_request_trailer is the trailer bit that requests a checksum echo (see verify).
+    static constexpr uint8_t checksum_request_trailer = 1 << 5;
+
+    /// echo_delay is the time given to the firmware to set the acknowledge pin after each echo request edge.
+    static constexpr std::chrono::nanoseconds echo_delay = std::chrono::milliseconds(1);
+
+    /// buffer_depth_shift is the position of the buffer depth in the trailer byte (0 selects max_buffer_depth).
+    static constexpr uint8_t buffer_depth_shift = 2;
+
+    /// synchronization_threshold is the shortest brightness acknowledge wait attributed to a display period boundary.
+    static constexpr std::chrono::nanoseconds synchronization_threshold = std::chrono::microseconds(50);
+
+    /// pacing_margin is how early a paced brightness byte is sent before the estimated display period boundary.
+    /// The handshake then waits for the actual boundary, which keeps the estimate synchronized.
+    static constexpr std::chrono::nanoseconds pacing_margin = std::chrono::microseconds(500);
+
+    /// fast_polls is the number of acknowledge polls between clock reads. Most handshakes complete before the first
+    /// clock read.
+    static constexpr uint8_t fast_polls = 16;
+
+    /// transmit sends a frame, and resyncs and sends it again after an acknowledge timeout if recovery is enabled
+    /// (see set_acknowledge_timeout). The firmware discards an interrupted transfer, and resync makes the next one
+    /// a full frame.
+    void transmit(uint8_t brightness, const uint8_t* pixels, uint8_t trailer, bool wire_ordered = false) {
+        for (uint32_t attempt = 0;; ++attempt) {
+            try {
+                transmit_once(brightness, pixels, trailer, wire_ordered);
+                return;
+            } catch (const std::runtime_error&) {
+                if (attempt >= _recovery_attempts) {
+                    throw;
+                }
+            }
+            resync();
+            ++_recoveries;
+            _instrumentation.count_recovery();
+        }
+    }
+
+    /// transmit_once sends the brightness, the pixels in wire order and the trailer byte.
+    /// pixels are permuted unless wire_ordered is true. The frame is replayed from its compiled waveform if the
+    /// waveform cache is enabled.
+    void transmit_once(uint8_t brightness, const uint8_t* pixels, uint8_t trailer, bool wire_ordered) {
+        if (_buffer_depth < max_buffer_depth) {
+            trailer |= static_cast<uint8_t>(_buffer_depth << buffer_depth_shift);
+        }
+        if (_deltas || _delta_next) {
+            transmit_delta(brightness, pixels, trailer, wire_ordered);
+            return;
+        }
+        if (_waveforms && !wire_ordered) {
+            const auto key = waveform_cache::hash(brightness, pixels, frame_size(), trailer);
+            auto words = _waveforms->find(key, brightness, pixels, frame_size(), trailer);
+            if (words == nullptr) {
+                auto& new_words = _waveforms->insert(key, brightness, pixels, frame_size(), trailer);
+                compile(brightness, pixels, trailer, new_words);
+                words = &new_words;
+            }
+            replay(*words, trailer);
+            return;
+        }
+        auto request = true;
+        auto acknowledge = true;
+        std::chrono::steady_clock::time_point first_byte_begin;
+        if constexpr (instrumentation_enabled) {
+            first_byte_begin = std::chrono::steady_clock::now();
+        }
+        send_byte(brightness, request, acknowledge, true); // send the duty cycle
+        const auto transfer_begin = std::chrono::steady_clock::now();
+        if constexpr (instrumentation_enabled) {
+            _instrumentation.record_first_byte(transfer_begin - first_byte_begin);
+        }
+        if (wire_ordered) {
+            for (uint16_t index = 0; index < frame_size(); ++index) {
+                send_byte(pixels[index], request, acknowledge);
+            }
+        } else if constexpr (dynamic) {
+            for (const auto index : _wire_order) {
+                send_byte(pixels[index], request, acknowledge);
+            }
+        } else {
+            for (const auto index : _static_wire_order) {
+                send_byte(pixels[index], request, acknowledge);
+            }
+        }
+        send_byte(trailer, request, acknowledge); // the trailer evens the payload and delimits groups
+        complete_transfer(first_byte_begin, transfer_begin, trailer, frame_size() + 2u);
+    }
+
+    /// checksum calculates the Fletcher-16 checksum (8-bit sums) of a frame as stored in the firmware's frame buffer:
+    /// the brightness as is, then the inverted pixels in wire order.
+    uint16_t checksum(const std::vector<uint8_t>& frame) const {
+        uint8_t sum = frame[0];
+        uint8_t sum_of_sums = sum;
+        const auto add = [&](uint8_t byte) {
+            sum = static_cast<uint8_t>(sum + static_cast<uint8_t>(~byte));
+            sum_of_sums = static_cast<uint8_t>(sum_of_sums + sum);
+        };
+        if constexpr (dynamic) {
+            for (const auto index : _wire_order) {
+                add(frame[index + 1]);
+            }
+        } else {
+            for (const auto index : _static_wire_order) {
+                add(frame[index + 1]);
+            }
+        }
+        return static_cast<uint16_t>((sum_of_sums << 8) | sum);
+    }
+
+    /// read_checksum reads the firmware's checksum echo after a transfer with checksum_request_trailer.
+    /// Each of the first 16 request edges asks for a bit (most significant first), which is sampled on the acknowledge
+    /// pin echo_delay later. The 17th edge ends the echo, and the 18th edge releases the request pin.
+    uint16_t read_checksum() {
+        uint16_t result = 0;
+        for (uint8_t edge = 0; edge < 18; ++edge) {
+            _gpio.write((edge & 1) == 0 ? set_offset : clear_offset, request_mask);
+            std::this_thread::sleep_for(echo_delay);
+            if (edge < 16) {
+                result = static_cast<uint16_t>((result << 1) | (acknowledged(true) ? 1 : 0));
+            }
+        }
+        _previous_write = std::chrono::high_resolution_clock::now();
+        return result;
+    }
+
+    /// compile calculates the set and clear words of the brightness, the pixels in wire order and the trailer byte.
+    void compile(uint8_t brightness, const uint8_t* pixels, uint8_t trailer, std::vector<uint32_t>& words) const {
+        words.reserve(2 * (frame_size() + 2u));
+        const auto add = [&](uint8_t byte, bool first) {
+            const auto mask = _byte_to_mask[byte];
+            const auto inverse_mask = (~mask) & std::get<255>(_byte_to_mask);
+            words.push_back(first ? mask : inverse_mask);
+            words.push_back(first ? inverse_mask : mask);
+        };
+        add(brightness, true);
+        if constexpr (dynamic) {
+            for (const auto index : _wire_order) {
+                add(pixels[index], false);
+            }
+        } else {
+            for (const auto index : _static_wire_order) {
+                add(pixels[index], false);
+            }
+        }
+        add(trailer, false);
+    }
+
+    /// replay transmits a waveform calculated by compile, trailer is the last byte of the waveform.
+    void replay(const std::vector<uint32_t>& words, uint8_t trailer) {
+        auto request = true;
+        auto acknowledge = true;
+        std::chrono::steady_clock::time_point first_byte_begin;
+        if constexpr (instrumentation_enabled) {
+            first_byte_begin = std::chrono::steady_clock::now();
+        }
+        send_words(words[0], words[1], request, acknowledge, true);
+        const auto transfer_begin = std::chrono::steady_clock::now();
+        if constexpr (instrumentation_enabled) {
+            _instrumentation.record_first_byte(transfer_begin - first_byte_begin);
+        }
+        for (std::size_t index = 2; index < words.size(); index += 2) {
+            send_words(words[index], words[index + 1], request, acknowledge);
+        }
+        complete_transfer(first_byte_begin, transfer_begin, trailer, frame_size() + 2u);
+    }
+
+    /// delta_block_size is the number of wire bytes per delta block.
+    static constexpr uint16_t delta_block_size = 16;
+
+    /// delta_next_trailer is the trailer bit that announces a delta transfer.
+    static constexpr uint8_t delta_next_trailer = 2;
+
+    /// delta_idle_limit is the longest idle time after which the firmware is known to still expect a delta transfer.
+    static constexpr std::chrono::nanoseconds delta_idle_limit = 7 * display_period;
+
+    /// delta_reset_delay is the idle time after which the firmware is known to have left delta mode.
+    static constexpr std::chrono::nanoseconds delta_reset_delay = 10 * display_period;
+
+    /// delta_header_size returns the size of the changed blocks bitmap, padded to an even number of bytes.
+    uint16_t delta_header_size() const {
+        return (frame_size() / delta_block_size + 15) / 16 * 2;
+    }
+
+    /// transmit_delta sends the brightness, the pixels and the trailer with the delta protocol (see send_deltas).
+    /// The pixels are sent in full if the firmware does not expect a delta transfer.
+    void transmit_delta(uint8_t brightness, const uint8_t* pixels, uint8_t trailer, bool wire_ordered) {
+        _wire_frame.resize(frame_size());
+        if (wire_ordered) {
+            std::copy(pixels, pixels + frame_size(), _wire_frame.begin());
+        } else if constexpr (dynamic) {
+            for (uint16_t index = 0; index < frame_size(); ++index) {
+                _wire_frame[index] = pixels[_wire_order[index]];
+            }
+        } else {
+            for (uint16_t index = 0; index < frame_size(); ++index) {
+                _wire_frame[index] = pixels[_static_wire_order[index]];
+            }
+        }
+        auto delta = _delta_next;
+        if (delta && std::chrono::high_resolution_clock::now() - _previous_write > delta_idle_limit) {
+            std::this_thread::sleep_until(_previous_write + delta_reset_delay);
+            delta = false;
+        }
+        _delta_header.assign(delta_header_size(), 0);
+        std::size_t bytes = frame_size() + 2u;
+        if (delta) {
+            bytes = _delta_header.size() + 2u;
+            for (uint16_t block = 0; block < frame_size() / delta_block_size; ++block) {
+                const auto offset = block * delta_block_size;
+                if (!std::equal(
+                        std::next(_wire_frame.begin(), offset),
+                        std::next(_wire_frame.begin(), offset + delta_block_size),
+                        std::next(_previous_wire_frame.begin(), offset))) {
+                    _delta_header[block / 8] |= static_cast<uint8_t>(1 << (block % 8));
+                    bytes += delta_block_size;
+                }
+            }
+        }
         auto request = true;
         auto acknowledge = true;
-        send_byte(frame[0], request, acknowledge, true); // send the duty cycle
-        for (uint8_t ab = 0; ab < 4; ++ab) {
-            for (uint8_t panel = 0; panel < _width * _height; ++panel) {
-                for (uint8_t column = 0; column < 4; ++column) {
-                    for (uint8_t row = 0; row < 4; ++row) {
-                        send_byte(
-                            frame[display_coordinates_to_frame_index(_width, _height, ab, panel, row, column) + 1],
-                            request,
-                            acknowledge);
+        std::chrono::steady_clock::time_point first_byte_begin;
+        if constexpr (instrumentation_enabled) {
+            first_byte_begin = std::chrono::steady_clock::now();
+        }
+        send_byte(brightness, request, acknowledge, true);
+        const auto transfer_begin = std::chrono::steady_clock::now();
+        if constexpr (instrumentation_enabled) {
+            _instrumentation.record_first_byte(transfer_begin - first_byte_begin);
+        }
+        if (delta) {
+            for (const auto byte : _delta_header) {
+                send_byte(byte, request, acknowledge);
+            }
+            for (uint16_t block = 0; block < frame_size() / delta_block_size; ++block) {
+                if ((_delta_header[block / 8] >> (block % 8)) & 1) {
+                    for (uint16_t index = block * delta_block_size; index < (block + 1) * delta_block_size;
+                         ++index) {
+                        send_byte(_wire_frame[index], request, acknowledge);
                     }
                 }
             }
+        } else {
+            for (const auto byte : _wire_frame) {
+                send_byte(byte, request, acknowledge);
+            }
         }
-        send_byte(0, request, acknowledge); // send an extra byte to even the payload
+        send_byte(_deltas ? trailer | delta_next_trailer : trailer, request, acknowledge);
+        _delta_next = _deltas;
+        _previous_wire_frame.swap(_wire_frame);
+        complete_transfer(first_byte_begin, transfer_begin, trailer, bytes);
+    }
+
+    /// complete_transfer updates the counters and the presentation time estimate after a transfer.
+    void complete_transfer(
+        std::chrono::steady_clock::time_point first_byte_begin,
+        std::chrono::steady_clock::time_point transfer_begin,
+        uint8_t trailer,
+        std::size_t bytes) {
         _previous_write = std::chrono::high_resolution_clock::now();
+        const auto now = std::chrono::steady_clock::now();
+        _transfer_duration = now - transfer_begin;
+        ++_sent;
+        _instrumentation.record_transfer(_transfer_duration);
+        _instrumentation.count_frame(bytes);
+        if constexpr (instrumentation_enabled) {
+            // the jitter is the excess over the fastest observed byte duration, hence it does not depend on the
+            // transfer size (delta transfers), and the brightness byte is not part of the transfer duration
+            const auto transferred = static_cast<double>(bytes - 1);
+            _fastest_byte_duration = std::min(_fastest_byte_duration, _transfer_duration.count() / transferred);
+            _instrumentation.record_jitter(std::chrono::nanoseconds(
+                static_cast<int64_t>(_transfer_duration.count() - _fastest_byte_duration * transferred)));
+        }
+        ++_group_slots;
+        _firmware_buffer_depth = _buffer_depth;
+        if ((trailer & pending_plane_trailer) == 0) {
+            // the group is displayed at the next period boundary, or after a full pass over the previous group
+            const auto presentation_time = std::max(
+                next_boundary(now),
+                _presentation_times[(_presentation_index + 7) % 8] + _previous_group_slots * display_period);
+            _presentation_times[_presentation_index] = presentation_time;
+            _presentation_index = (_presentation_index + 1) % 8;
+            _previous_group_slots = _group_slots;
+            _group_slots = 0;
+            if constexpr (instrumentation_enabled) {
+                _instrumentation.record_presentation(presentation_time - first_byte_begin);
+            }
+        }
     }
 
-    protected:
-    /// display_coordinates_to_frame_index converts a display byte position to a frame index.
-    /// The frame must be in row major order.
-    ///     - width is the number of panels (horizontaly)
-    ///     - height is the number of panels (verticaly)
-    ///     - ab is the row block index, in the range [0, 4[
-    ///     - panel is the s-pattern panel index, in the range [0, width * height[
-    ///     - column is the column index, in the range [0, 4[
-    ///     - row is the interlaced row index, in the range [0, 4[
-    /// The Arduino is connected to the panel with coordinates (width - 1, height - 1)
-    /// Both the panel and pixel coordinates use the conventional frame coordinate system, with the origin at the top
-    /// left.
-    const uint16_t display_coordinates_to_frame_index(
-        uint8_t width,
-        uint8_t height,
-        uint8_t ab,
-        uint8_t panel,
-        uint8_t row,
-        uint8_t column) {
-        return column + (panel % width) * 4 + ((3 - row) * 4 + ab + (panel / width) * 16) * width * 4;
+    /// next_boundary returns the first estimated display period boundary at or after time.
+    std::chrono::steady_clock::time_point next_boundary(std::chrono::steady_clock::time_point time) const {
+        if (time <= _display_boundary) {
+            return _display_boundary;
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(time - _display_boundary);
+        return _display_boundary + ((elapsed.count() - 1) / display_period.count() + 1) * display_period;
+    }
+
+    /// synchronize aligns the presentation time estimates with a display period boundary observed at time.
+    /// The firmware acknowledges a brightness byte that waited for a free slot as soon as the display moves to the
+    /// next slot, which is when the group received buffer_depth groups ago is presented.
+    void synchronize(std::chrono::steady_clock::time_point time) {
+        const auto offset = time - _presentation_times[(_presentation_index + 8 - _firmware_buffer_depth) % 8];
+        for (uint8_t index = 1; index <= _firmware_buffer_depth; ++index) {
+            _presentation_times[(_presentation_index + 8 - index) % 8] += offset;
+        }
+        _display_boundary = time;
     }
 
     /// request_mask selects the request signal pin.
@@ -203,32 +860,129 @@ class led_panel {
         0b00000100000010010010000001100000, 0b00000100000110010010000001100000, 0b00000100001010010010000001100000,
         0b00000100001110010010000001100000};
 
-    /// send_byte sends a single byte to the display.
-    void send_byte(uint8_t byte, bool& request, bool& acknowledge, bool first = false) {
-        for (uint8_t index = 0; index < 64; ++index) {
-            asm volatile("nop");
-        }
-        *(_gpios + (first ? set_offset : clear_offset)) = _byte_to_mask[byte];
-        *(_gpios + (first ? clear_offset : set_offset)) = (~_byte_to_mask[byte]) & std::get<255>(_byte_to_mask);
-        for (uint8_t index = 0; index < 64; ++index) {
+    /// delay executes the given number of nop instructions.
+    static void delay(uint16_t nops) {
+        for (uint16_t index = 0; index < nops; ++index) {
             asm volatile("nop");
         }
-        *(_gpios + (request ? set_offset : clear_offset)) = request_mask;
+    }
+
+    /// send_byte sends a single byte to the display.
+    /// The first byte (brightness) is sent as is, and the other bytes are inverted.
+    void send_byte(uint8_t byte, bool& request, bool& acknowledge, bool first = false) {
+        const auto mask = _byte_to_mask[byte];
+        const auto inverse_mask = (~mask) & std::get<255>(_byte_to_mask);
+        send_words(first ? mask : inverse_mask, first ? inverse_mask : mask, request, acknowledge, first);
+    }
+
+    /// send_words sets and clears the data pins, then toggles the request pin and waits for the acknowledge signal.
+    void send_words(uint32_t set_word, uint32_t clear_word, bool& request, bool& acknowledge, bool first = false) {
+        delay(_timing.hold);
+        _gpio.write(set_offset, set_word);
+        _gpio.write(clear_offset, clear_word);
+        delay(_timing.setup);
+        _gpio.write(request ? set_offset : clear_offset, request_mask);
         request = !request;
         if (first) {
             std::this_thread::sleep_until(_previous_write + std::chrono::microseconds(100));
-            if (((*(_gpios + level_offset) >> acknowledge_pin) & 1) != acknowledge) {
+            if (_buffer_depth < max_buffer_depth) {
+                if (_group_slots == 0) {
+                    // the firmware receives a new group once the group sent buffer_depth groups ago is displayed
+                    std::this_thread::sleep_until(
+                        _presentation_times[(_presentation_index + 8 - _firmware_buffer_depth) % 8] - pacing_margin);
+                }
+            } else if (((_gpio.read(level_offset) >> acknowledge_pin) & 1) != acknowledge) {
+                _instrumentation.count_fallback_sleep();
                 std::this_thread::sleep_until(_previous_write + std::chrono::milliseconds(15));
             }
         }
-        while ((((*(_gpios + level_offset) >> acknowledge_pin) & 1) == 1) != acknowledge) {
+        std::chrono::steady_clock::time_point wait_begin;
+        if (instrumentation_enabled || first) {
+            wait_begin = std::chrono::steady_clock::now();
+        }
+        wait_acknowledge(acknowledge);
+        if (first && _group_slots == 0) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now - wait_begin > synchronization_threshold) {
+                synchronize(now);
+            }
+        }
+        if constexpr (instrumentation_enabled) {
+            if (!first) {
+                const auto wait = std::chrono::steady_clock::now() - wait_begin;
+                _instrumentation.record_acknowledge_wait(wait);
+                if (wait > 8 * display_period) {
+                    _instrumentation.count_stall();
+                }
+            }
         }
         acknowledge = !acknowledge;
     }
 
+    /// acknowledged returns true if the acknowledge pin has the given level.
+    bool acknowledged(bool acknowledge) {
+        return (((_gpio.read(level_offset) >> acknowledge_pin) & 1) == 1) == acknowledge;
+    }
+
+    /// wait_acknowledge waits until the acknowledge pin has the given level.
+    /// The pin is polled in a tight loop for the spin limit, then the thread yields between polls. The wait throws a
+    /// std::runtime_error if the acknowledge timeout is not zero and elapses.
+    void wait_acknowledge(bool acknowledge) {
+        for (uint8_t poll = 0; poll < fast_polls; ++poll) {
+            if (acknowledged(acknowledge)) {
+                return;
+            }
+        }
+        const auto begin = std::chrono::steady_clock::now();
+        for (;;) {
+            for (uint8_t poll = 0; poll < fast_polls; ++poll) {
+                if (acknowledged(acknowledge)) {
+                    return;
+                }
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - begin;
+            if (_acknowledge_timeout.count() > 0 && elapsed > _acknowledge_timeout) {
+                _instrumentation.count_acknowledge_timeout();
+                throw std::runtime_error("acknowledge timeout");
+            }
+            if (elapsed >= _spin_limit) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /// _static_wire_order is the wire order of a static layout (empty if the layout is dynamic).
+    static constexpr std::array<uint16_t, 64 * Width * Height> _static_wire_order = static_wire_order<Width, Height>();
+
     const uint8_t _width;
     const uint8_t _height;
-    int32_t _memory_file_descriptor;
-    volatile uint32_t* _gpios;
+    const std::vector<uint16_t> _wire_order;
+    Gpio _gpio;
     std::chrono::high_resolution_clock::time_point _previous_write;
+    handshake_timing _timing = default_handshake_timing;
+    std::chrono::nanoseconds _acknowledge_timeout;
+    uint32_t _recovery_attempts;
+    std::chrono::nanoseconds _spin_limit = std::chrono::microseconds(200);
+    uint64_t _recoveries = 0;
+    double _fastest_byte_duration = std::numeric_limits<double>::infinity();
+    bool _skip_unchanged = false;
+    std::chrono::milliseconds _keep_alive;
+    std::vector<uint8_t> _previous_frame;
+    uint64_t _sent = 0;
+    uint64_t _skipped = 0;
+    std::chrono::nanoseconds _transfer_duration = std::chrono::nanoseconds(0);
+    led_panel_instrumentation _instrumentation;
+    std::unique_ptr<waveform_cache> _waveforms;
+    bool _deltas = false;
+    bool _delta_next = false;
+    std::vector<uint8_t> _wire_frame;
+    std::vector<uint8_t> _previous_wire_frame;
+    std::vector<uint8_t> _delta_header;
+    uint8_t _buffer_depth = max_buffer_depth;
+    uint8_t _firmware_buffer_depth = max_buffer_depth;
+    std::chrono::steady_clock::time_point _display_boundary;
+    std::array<std::chrono::steady_clock::time_point, 8> _presentation_times;
+    uint8_t _presentation_index = 0;
+    uint16_t _group_slots = 0;
+    uint16_t _previous_group_slots = 0;
 };
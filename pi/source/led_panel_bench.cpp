@@ -0,0 +1,848 @@
+#include "compositor.hpp"
+#include "event_renderer.hpp"
+#include "grayscale_packer.hpp"
+#include "led_panel.hpp"
+#include "packed_raster.hpp"
+#include "realtime.hpp"
+#include "simulated_arduino.hpp"
+#include "temporal_grayscale.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// conversion_probe exposes the waveform compilation of led_panel, which performs the byte to mask conversions of an
+/// uncached send without the handshakes.
+class conversion_probe : public led_panel<dynamic_layout, dynamic_layout, simulated_gpio> {
+    public:
+    using led_panel<dynamic_layout, dynamic_layout, simulated_gpio>::led_panel;
+
+    /// convert calculates the register words of a frame.
+    void convert(const std::vector<uint8_t>& frame, std::vector<uint32_t>& words) const {
+        words.clear();
+        compile(frame[0], frame.data() + 1, group_end_trailer, words);
+    }
+};
+
+/// packing_matches_reference compares the packing kernels with the scalar reference, for several frame shapes.
+bool packing_matches_reference(instruction_set set, dithering method, std::mt19937& engine) {
+    std::uniform_int_distribution<uint16_t> distribution(0, 255);
+    for (uint16_t width = 8; width <= 264; width += 8) {
+        for (uint16_t height = 1; height <= 17; height += 4) {
+            std::vector<uint8_t> grayscale(width * height);
+            for (auto& level : grayscale) {
+                level = static_cast<uint8_t>(distribution(engine));
+            }
+            const auto threshold = static_cast<uint8_t>(distribution(engine));
+            grayscale_packer reference(width, height, method, threshold, instruction_set::scalar);
+            grayscale_packer packer(width, height, method, threshold, set);
+            std::vector<uint8_t> expected(width * height / 8);
+            std::vector<uint8_t> packed(width * height / 8);
+            reference.pack(grayscale.data(), expected.data());
+            packer.pack(grayscale.data(), packed.data());
+            if (packed != expected) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/// reference_combine applies a raster operation to a single pixel.
+bool reference_combine(bool pixel, bool source, raster_op op) {
+    switch (op) {
+        case raster_op::copy:
+            return source;
+        case raster_op::bitwise_or:
+            return pixel || source;
+        case raster_op::bitwise_xor:
+            return pixel != source;
+        case raster_op::bitwise_and:
+            return pixel && source;
+    }
+    return pixel;
+}
+
+/// raster_matches_reference applies random operations to packed rasters and to one byte per pixel images, for several
+/// display shapes, and compares the results after each operation.
+bool raster_matches_reference(std::mt19937& engine) {
+    std::uniform_int_distribution<uint16_t> bytes(0, 255);
+    std::uniform_int_distribution<int32_t> operations(0, 4);
+    std::uniform_int_distribution<int32_t> ops(0, 3);
+    std::uniform_int_distribution<int32_t> sizes(0, 48);
+    std::uniform_int_distribution<int32_t> characters(30, 130);
+    for (const auto& shape : std::vector<std::pair<uint8_t, uint8_t>>{{1, 1}, {3, 1}, {2, 2}}) {
+        packed_raster raster(shape.first, shape.second);
+        const auto width = raster.width();
+        const auto height = raster.height();
+        std::vector<uint8_t> image(width * height, 0);
+        std::uniform_int_distribution<int32_t> columns(-40, width + 8);
+        std::uniform_int_distribution<int32_t> rows(-20, height + 4);
+        int32_t clip_left = 0;
+        int32_t clip_top = 0;
+        int32_t clip_right = width;
+        int32_t clip_bottom = height;
+
+        // draw combines source(x, y) with the image pixels of the rectangle, within the clip rectangle
+        // source returns -1 for pixels that must not be modified
+        const auto draw = [&](int32_t x,
+                              int32_t y,
+                              int32_t rectangle_width,
+                              int32_t rectangle_height,
+                              raster_op op,
+                              const std::function<int32_t(int32_t, int32_t)>& source) {
+            for (auto row = std::max(y, clip_top); row < std::min(y + rectangle_height, clip_bottom); ++row) {
+                for (auto column = std::max(x, clip_left); column < std::min(x + rectangle_width, clip_right);
+                     ++column) {
+                    const auto value = source(column - x, row - y);
+                    auto& pixel = image[row * width + column];
+                    if (value >= 0) {
+                        pixel = reference_combine(pixel != 0, value == 1, op) ? 1 : 0;
+                    }
+                }
+            }
+        };
+        for (uint32_t operation = 0; operation < 2000; ++operation) {
+            const auto op = static_cast<raster_op>(ops(engine));
+            switch (operations(engine)) {
+                case 0: {
+                    if (bytes(engine) < 64) {
+                        raster.reset_clip();
+                        clip_left = 0;
+                        clip_top = 0;
+                        clip_right = width;
+                        clip_bottom = height;
+                    } else {
+                        const auto x = columns(engine);
+                        const auto y = rows(engine);
+                        const auto clip_width = sizes(engine) * 2;
+                        const auto clip_height = sizes(engine);
+                        raster.set_clip(x, y, clip_width, clip_height);
+                        clip_left = std::clamp(x, 0, width);
+                        clip_top = std::clamp(y, 0, height);
+                        clip_right = std::max(clip_left, std::clamp(x + clip_width, 0, width));
+                        clip_bottom = std::max(clip_top, std::clamp(y + clip_height, 0, height));
+                    }
+                    break;
+                }
+                case 1: {
+                    const auto x = columns(engine);
+                    const auto y = rows(engine);
+                    const auto rectangle_width = sizes(engine);
+                    const auto rectangle_height = sizes(engine);
+                    const auto on = bytes(engine) < 128;
+                    raster.fill_rect(x, y, rectangle_width, rectangle_height, on, op);
+                    draw(x, y, rectangle_width, rectangle_height, op, [&](int32_t, int32_t) { return on ? 1 : 0; });
+                    break;
+                }
+                case 2: {
+                    packed_bitmap sprite;
+                    sprite.width = static_cast<uint16_t>(sizes(engine) + 1);
+                    sprite.height = static_cast<uint16_t>(sizes(engine) / 2 + 1);
+                    sprite.stride = static_cast<uint16_t>((sprite.width + 7) / 8 + bytes(engine) % 3);
+                    std::vector<uint8_t> data(sprite.stride * sprite.height);
+                    for (auto& byte : data) {
+                        byte = static_cast<uint8_t>(bytes(engine));
+                    }
+                    sprite.data = data.data();
+                    const auto source_x = sizes(engine) / 4 - 4;
+                    const auto source_y = sizes(engine) / 8 - 2;
+                    const auto rectangle_width = sizes(engine);
+                    const auto rectangle_height = sizes(engine) / 2;
+                    const auto x = columns(engine);
+                    const auto y = rows(engine);
+                    raster.blit(sprite, source_x, source_y, rectangle_width, rectangle_height, x, y, op);
+                    draw(x, y, rectangle_width, rectangle_height, op, [&](int32_t column, int32_t row) {
+                        column += source_x;
+                        row += source_y;
+                        if (column < 0 || row < 0 || column >= sprite.width || row >= sprite.height) {
+                            return -1;
+                        }
+                        return (data[row * sprite.stride + column / 8] >> (7 - column % 8)) & 1;
+                    });
+                    break;
+                }
+                case 3: {
+                    std::string text(static_cast<std::size_t>(sizes(engine) / 4), ' ');
+                    for (auto& character : text) {
+                        character = static_cast<char>(characters(engine));
+                    }
+                    const auto& font = font_5x7();
+                    const auto atlas = font.atlas();
+                    const auto x = columns(engine);
+                    const auto y = rows(engine);
+                    raster.draw_text(font, text, x, y, op);
+                    for (std::size_t index = 0; index < text.size(); ++index) {
+                        const auto cell = font.cell(text[index]);
+                        draw(
+                            x + static_cast<int32_t>(index) * font.advance(),
+                            y,
+                            font.advance(),
+                            font.height(),
+                            op,
+                            [&](int32_t column, int32_t row) {
+                                if (cell < 0) {
+                                    return 0;
+                                }
+                                column += cell * font.advance();
+                                return (atlas.data[row * atlas.stride + column / 8] >> (7 - column % 8)) & 1;
+                            });
+                    }
+                    break;
+                }
+                case 4: {
+                    const auto dx = sizes(engine) - 24;
+                    const auto dy = sizes(engine) / 2 - 12;
+                    const auto wrap = bytes(engine) < 128;
+                    raster.scroll(dx, dy, wrap);
+                    const auto previous = image;
+                    const auto clip_width = clip_right - clip_left;
+                    const auto clip_height = clip_bottom - clip_top;
+                    draw(0, 0, width, height, raster_op::copy, [&](int32_t column, int32_t row) {
+                        auto source_column = column - clip_left - dx;
+                        auto source_row = row - clip_top - dy;
+                        if (wrap) {
+                            source_column = ((source_column % clip_width) + clip_width) % clip_width;
+                            source_row = ((source_row % clip_height) + clip_height) % clip_height;
+                        } else if (
+                            source_column < 0 || source_column >= clip_width || source_row < 0
+                            || source_row >= clip_height) {
+                            return 0;
+                        }
+                        return static_cast<int32_t>(
+                            previous[(source_row + clip_top) * width + source_column + clip_left]);
+                    });
+                    break;
+                }
+                default:
+                    break;
+            }
+            for (int32_t y = 0; y < height; ++y) {
+                for (int32_t x = 0; x < width; ++x) {
+                    if (raster.pixel(x, y) != (image[y * width + x] != 0)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/// generate_events fills records with synthetic events (see event_record_size) from a sensor of the given size.
+/// The stream alternates between bursts and quiet periods: each millisecond has either 5 times the average rate (with
+/// a probability of 0.2) or no events, as if the sensor observed sudden motion.
+void generate_events(
+    std::vector<uint8_t>& records,
+    uint16_t sensor_width,
+    uint16_t sensor_height,
+    double rate,
+    std::mt19937& engine) {
+    std::uniform_int_distribution<uint16_t> columns(0, sensor_width - 1);
+    std::uniform_int_distribution<uint16_t> rows(0, sensor_height - 1);
+    std::bernoulli_distribution burst(0.2);
+    const auto burst_events = static_cast<std::size_t>(std::max(5.0 * rate / 1000.0, 1.0));
+    const auto count = records.size() / event_record_size;
+    uint64_t millisecond = 0;
+    for (std::size_t index = 0; index < count; ++millisecond) {
+        if (!burst(engine)) {
+            continue;
+        }
+        for (std::size_t event = 0; event < burst_events && index < count; ++event, ++index) {
+            const uint64_t t = millisecond * 1000 + event * 1000 / burst_events;
+            const auto x = columns(engine);
+            const auto y = rows(engine);
+            const uint8_t on = x & 1;
+            const auto record = records.data() + index * event_record_size;
+            std::memcpy(record, &t, sizeof(t));
+            std::memcpy(record + 8, &x, sizeof(x));
+            std::memcpy(record + 10, &y, sizeof(y));
+            record[12] = on;
+        }
+    }
+}
+
+/// percentile returns the value at the given rank of sorted durations, in microseconds.
+double percentile(const std::vector<std::chrono::nanoseconds>& durations, double rank) {
+    const auto index = static_cast<std::size_t>(rank * (durations.size() - 1) + 0.5);
+    return durations[index].count() / 1e3;
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t frames = 100;
+    try {
+        if (argc > 2) {
+            throw std::runtime_error("bad number of arguments");
+        }
+        if (argc == 2) {
+            frames = std::stoul(argv[1]);
+            if (frames == 0) {
+                throw std::out_of_range("frames must be larger than 0");
+            }
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what()
+                  << "\nsyntax: led_panel_bench [frames]\n    frames is the number of frames sent per layout (defaults "
+                     "to 100)"
+                  << std::endl;
+        return 1;
+    }
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<uint16_t> distribution(0, 255);
+    std::cout << std::setw(6) << "panels" << std::setw(12) << "bytes/frame" << std::setw(12) << "frames/s"
+              << std::setw(12) << "bytes/s" << std::setw(12) << "p50 (us)" << std::setw(12) << "p90 (us)"
+              << std::setw(12) << "p99 (us)" << std::setw(12) << "max (us)" << std::setw(14) << "handshakes"
+              << std::setw(16) << "round-trip (ns)" << std::setw(10) << "timeouts" << std::endl;
+    for (uint8_t panels = 1; panels <= 16; ++panels) {
+        simulated_arduino arduino(panels, 1);
+        led_panel display(panels, 1, simulated_gpio(arduino));
+        std::vector<std::vector<uint8_t>> contents(8, std::vector<uint8_t>(64 * panels + 1));
+        for (auto& content : contents) {
+            for (auto& byte : content) {
+                byte = static_cast<uint8_t>(distribution(engine));
+            }
+        }
+        std::vector<std::chrono::nanoseconds> durations;
+        durations.reserve(frames);
+        const auto first = arduino.snapshot();
+        const auto begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < frames; ++index) {
+            const auto send_begin = std::chrono::steady_clock::now();
+            display.send(contents[index % contents.size()]);
+            durations.push_back(std::chrono::steady_clock::now() - send_begin);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        const auto last = arduino.snapshot();
+        std::sort(durations.begin(), durations.end());
+        const auto handshakes = last.handshakes - first.handshakes;
+        const auto transfer_duration = static_cast<double>((last.transfer_duration - first.transfer_duration).count());
+        const auto pixel_bytes = static_cast<double>((last.frames - first.frames) * (64 * panels - 1));
+        std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(panels)
+                  << std::setw(12) << 64 * panels + 2 << std::setw(12)
+                  << frames / std::chrono::duration<double>(end - begin).count() << std::setw(12)
+                  << pixel_bytes / (transfer_duration / 1e9) << std::setw(12)
+                  << percentile(durations, 0.5) << std::setw(12) << percentile(durations, 0.9) << std::setw(12)
+                  << percentile(durations, 0.99) << std::setw(12) << durations.back().count() / 1e3 << std::setw(14)
+                  << static_cast<double>(handshakes) / frames << std::setw(16)
+                  << transfer_duration / pixel_bytes << std::setw(10) << last.timeouts - first.timeouts << std::endl;
+    }
+    std::cout << "\n"
+              << std::setw(16) << "dithering" << std::setw(8) << "set" << std::setw(16) << "pixels/s" << std::setw(12)
+              << "reference" << std::endl;
+    auto matches = true;
+    const std::vector<std::pair<dithering, std::string>> methods = {
+        {dithering::threshold, "threshold"},
+        {dithering::ordered, "ordered"},
+        {dithering::error_diffusion, "error-diffusion"}};
+    for (const auto& method : methods) {
+        for (const auto set :
+             {instruction_set::scalar, instruction_set::sse, instruction_set::avx2, instruction_set::neon}) {
+            if (!instruction_set_supported(set)
+                || (method.first == dithering::error_diffusion && set != instruction_set::scalar)) {
+                continue;
+            }
+            const auto set_matches = packing_matches_reference(set, method.first, engine);
+            matches &= set_matches;
+            grayscale_packer packer(512, 16, method.first, 128, set);
+            std::vector<uint8_t> grayscale(512 * 16);
+            for (auto& level : grayscale) {
+                level = static_cast<uint8_t>(distribution(engine));
+            }
+            std::vector<uint8_t> packed(512 * 16 / 8);
+            const std::size_t iterations = 1000 * frames;
+            const auto begin = std::chrono::steady_clock::now();
+            for (std::size_t index = 0; index < iterations; ++index) {
+                packer.pack(grayscale.data(), packed.data());
+                asm volatile("" : : "r"(packed.data()) : "memory");
+            }
+            const auto end = std::chrono::steady_clock::now();
+            std::cout << std::setw(16) << method.second << std::setw(8) << instruction_set_name(set) << std::setw(16)
+                      << std::setprecision(3) << std::scientific
+                      << iterations * grayscale.size() / std::chrono::duration<double>(end - begin).count()
+                      << std::setw(12) << (set_matches ? "match" : "MISMATCH") << std::endl;
+        }
+    }
+    std::cout << "\n"
+              << std::setw(6) << "panels" << std::setw(8) << "planes" << std::setw(20) << "plane transfer (us)"
+              << std::setw(12) << "budget (%)" << std::setw(12) << "groups/s" << std::setw(10) << "timeouts"
+              << std::endl;
+    const auto groups = std::max<std::size_t>(frames / 10, 4);
+    for (const uint8_t panels : {1, 2, 4, 8, 16}) {
+        for (uint8_t planes = 1; planes <= maximum_planes; ++planes) {
+            simulated_arduino arduino(panels, 1);
+            led_panel display(panels, 1, simulated_gpio(arduino));
+            temporal_grayscale<decltype(display)> grayscale(display, planes);
+            std::vector<std::vector<uint8_t>> contents(8, std::vector<uint8_t>(512 * panels));
+            for (auto& content : contents) {
+                for (auto& level : content) {
+                    level = static_cast<uint8_t>(distribution(engine));
+                }
+            }
+            std::chrono::nanoseconds transfer_duration(0);
+            const auto first = arduino.snapshot();
+            const auto begin = std::chrono::steady_clock::now();
+            for (std::size_t index = 0; index < groups; ++index) {
+                grayscale.send(255, contents[index % contents.size()].data());
+                transfer_duration += grayscale.plane_transfer_duration();
+            }
+            const auto end = std::chrono::steady_clock::now();
+            const auto last = arduino.snapshot();
+            const auto plane_transfer = std::chrono::duration<double>(transfer_duration).count() / groups;
+            const auto budget = plane_transfer / std::chrono::duration<double>(display_period).count();
+            std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(panels)
+                      << std::setw(8) << static_cast<uint32_t>(planes) << std::setw(20) << plane_transfer * 1e6
+                      << std::setw(12) << budget * 100 << std::setw(12)
+                      << groups / std::chrono::duration<double>(end - begin).count() << std::setw(10)
+                      << last.timeouts - first.timeouts << std::endl;
+        }
+    }
+    std::cout << "\n"
+              << std::setw(6) << "panels" << std::setw(10) << "cache" << std::setw(16) << "transfer (us)"
+              << std::setw(20) << "host work (ns)" << std::setw(8) << "hits" << std::setw(8) << "misses"
+              << std::setw(14) << "memory (B)" << std::endl;
+    for (const uint8_t panels : {1, 4, 16}) {
+        for (const std::size_t capacity : {0, 8}) {
+            simulated_arduino arduino(panels, 1);
+            conversion_probe display(panels, 1, simulated_gpio(arduino));
+            display.cache_waveforms(capacity);
+            std::vector<std::vector<uint8_t>> contents(8, std::vector<uint8_t>(64 * panels + 1));
+            for (auto& content : contents) {
+                for (auto& byte : content) {
+                    byte = static_cast<uint8_t>(distribution(engine));
+                }
+            }
+            std::chrono::nanoseconds transfer_duration(0);
+            for (std::size_t index = 0; index < frames; ++index) {
+                display.send(contents[index % contents.size()]);
+                transfer_duration += display.transfer_duration();
+            }
+            const auto statistics = display.waveform_statistics();
+
+            // the host work is the per-frame cost that does not depend on the handshakes: the byte to mask
+            // conversions without the cache, the hash and the lookup (including the content comparison) with it
+            constexpr std::size_t iterations = 10000;
+            std::vector<uint32_t> words;
+            waveform_cache lookups(capacity == 0 ? 1 : capacity);
+            for (const auto& content : contents) {
+                lookups.insert(
+                    waveform_cache::hash(content[0], content.data() + 1, display.frame_size(), 0),
+                    content[0],
+                    content.data() + 1,
+                    display.frame_size(),
+                    0);
+            }
+            const auto work_begin = std::chrono::steady_clock::now();
+            for (std::size_t index = 0; index < iterations; ++index) {
+                const auto& content = contents[index % contents.size()];
+                if (capacity == 0) {
+                    display.convert(content, words);
+                    asm volatile("" : : "r"(words.data()) : "memory");
+                } else {
+                    const auto key = waveform_cache::hash(content[0], content.data() + 1, display.frame_size(), 0);
+                    const auto found = lookups.find(key, content[0], content.data() + 1, display.frame_size(), 0);
+                    asm volatile("" : : "r"(found) : "memory");
+                }
+            }
+            const auto work = std::chrono::duration<double>(std::chrono::steady_clock::now() - work_begin).count();
+            std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(panels)
+                      << std::setw(10) << (capacity == 0 ? "off" : "8 frames") << std::setw(16)
+                      << std::chrono::duration<double>(transfer_duration).count() / frames * 1e6 << std::setw(20)
+                      << work / iterations * 1e9 << std::setw(8) << statistics.hits << std::setw(8)
+                      << statistics.misses << std::setw(14) << statistics.memory << std::endl;
+        }
+    }
+    std::cout << "\n"
+              << std::setw(6) << "depth" << std::setw(12) << "frames/s" << std::setw(16) << "latency (ms)"
+              << std::setw(20) << "max latency (ms)" << std::setw(18) << "estimate error" << std::setw(22)
+              << "max estimate error" << std::endl;
+    for (const uint8_t depth : {7, 2, 1}) {
+        simulated_arduino arduino(4, 1);
+        arduino.record_presentations(true);
+        led_panel display(4, 1, simulated_gpio(arduino));
+        display.set_buffer_depth(depth);
+        std::this_thread::sleep_for(8 * display_period); // the display shows the constructor's blank frames
+        std::vector<std::vector<uint8_t>> contents(8, std::vector<uint8_t>(64 * 4 + 1));
+        for (auto& content : contents) {
+            for (auto& byte : content) {
+                byte = static_cast<uint8_t>(distribution(engine));
+            }
+        }
+        std::vector<std::chrono::steady_clock::time_point> submissions;
+        std::vector<std::chrono::steady_clock::time_point> estimates;
+        const auto begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < frames; ++index) {
+            submissions.push_back(std::chrono::steady_clock::now());
+            display.send(contents[index % contents.size()]);
+            estimates.push_back(display.presentation_time());
+        }
+        const auto end = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(10 * display_period);
+        // the first 8 presentations are the constructor's blank frames
+        const auto presentations = arduino.presentations();
+        std::chrono::duration<double, std::milli> latency(0);
+        std::chrono::duration<double, std::milli> maximum_latency(0);
+        std::chrono::duration<double, std::milli> error(0);
+        std::chrono::duration<double, std::milli> maximum_error(0);
+        std::size_t presented = 0;
+        for (; presented < frames && presented + 8 < presentations.size(); ++presented) {
+            const auto frame_latency = presentations[presented + 8] - submissions[presented];
+            const auto frame_error = std::chrono::duration<double, std::milli>(
+                estimates[presented] > presentations[presented + 8] ?
+                    estimates[presented] - presentations[presented + 8] :
+                    presentations[presented + 8] - estimates[presented]);
+            latency += frame_latency;
+            maximum_latency = std::max(maximum_latency, std::chrono::duration<double, std::milli>(frame_latency));
+            error += frame_error;
+            maximum_error = std::max(maximum_error, frame_error);
+        }
+        std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(depth)
+                  << std::setw(12) << frames / std::chrono::duration<double>(end - begin).count() << std::setw(16)
+                  << latency.count() / std::max<std::size_t>(presented, 1) << std::setw(20) << maximum_latency.count()
+                  << std::setw(18) << error.count() / std::max<std::size_t>(presented, 1) << std::setw(22)
+                  << maximum_error.count() << std::endl;
+    }
+    std::cout << "\n"
+              << std::setw(6) << "panels" << std::setw(10) << "rendering" << std::setw(16) << "events/s"
+              << std::setw(14) << "ns/event" << std::setw(10) << "frames" << std::endl;
+    std::vector<uint8_t> records(frames * 20000 * event_record_size);
+    generate_events(records, 346, 260, 2e6, engine);
+    for (const uint8_t panels : {1, 4, 16}) {
+        for (const auto rendering : {event_rendering::window, event_rendering::decay}) {
+            event_renderer renderer(panels, 1, 346, 260, rendering, 20000);
+            std::size_t checksum = 0;
+            const auto begin = std::chrono::steady_clock::now();
+            for (std::size_t offset = 0; offset < records.size(); offset += (1 << 16) * event_record_size) {
+                renderer.process(
+                    records.data() + offset,
+                    std::min<std::size_t>(1 << 16, (records.size() - offset) / event_record_size),
+                    [&](const uint8_t* frame) { checksum += frame[1]; });
+            }
+            const auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            asm volatile("" : : "r"(checksum) : "memory");
+            std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(panels)
+                      << std::setw(10) << (rendering == event_rendering::window ? "window" : "decay")
+                      << std::setw(16) << std::setprecision(3) << std::scientific << renderer.events() / duration
+                      << std::setw(14) << std::fixed << std::setprecision(2) << duration / renderer.events() * 1e9
+                      << std::setw(10) << renderer.frames() << std::endl;
+        }
+    }
+    std::cout << "\n"
+              << std::setw(6) << "panels" << std::setw(16) << "path" << std::setw(14) << "ns/frame" << std::setw(12)
+              << "speedup" << std::setw(12) << "reference" << std::endl;
+    const auto raster_matches = raster_matches_reference(engine);
+    matches &= raster_matches;
+    const bitmap_font font(font_5x7_columns.data(), 5, 7, 32, 95, 1, 2);
+    const std::string text("LED PANEL TICKER 0123456789 ");
+    const auto atlas = font.atlas();
+    std::vector<uint8_t> atlas_levels(atlas.width * atlas.height);
+    for (uint16_t y = 0; y < atlas.height; ++y) {
+        for (uint16_t x = 0; x < atlas.width; ++x) {
+            atlas_levels[y * atlas.width + x] = ((atlas.data[y * atlas.stride + x / 8] >> (7 - x % 8)) & 1) * 255;
+        }
+    }
+    for (const uint8_t panels : {1, 4, 16}) {
+        const int32_t width = 32 * panels;
+        const auto iterations = 100 * frames;
+        const auto period = width + font.text_width(text);
+        const auto text_x = [&](std::size_t index) {
+            return width - static_cast<int32_t>(index % period);
+        };
+
+        // the byte path mimics numpy: one byte per pixel, glyph rows copied from a byte atlas, then pack
+        std::vector<uint8_t> image(width * 16);
+        std::vector<uint8_t> packed(width * 2);
+        grayscale_packer packer(width, 16, dithering::threshold, 128);
+        auto begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < iterations; ++index) {
+            std::fill(image.begin(), image.end(), 0);
+            auto x = text_x(index);
+            for (const auto character : text) {
+                const auto cell = font.cell(character);
+                const auto first = std::max(x, 0);
+                const auto last = std::min(x + font.advance(), width);
+                for (int32_t y = 0; first < last && y < font.height(); ++y) {
+                    std::copy(
+                        atlas_levels.begin() + y * atlas.width + cell * font.advance() + first - x,
+                        atlas_levels.begin() + y * atlas.width + cell * font.advance() + last - x,
+                        image.begin() + (y + 1) * width + first);
+                }
+                x += font.advance();
+            }
+            packer.pack(image.data(), packed.data());
+            asm volatile("" : : "r"(packed.data()) : "memory");
+        }
+        const auto bytes_duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        packed_raster redraw(panels, 1);
+        begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < iterations; ++index) {
+            redraw.clear();
+            redraw.draw_text(font, text, text_x(index), 1, raster_op::copy);
+            asm volatile("" : : "r"(redraw.pixels()) : "memory");
+        }
+        const auto redraw_duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        // the scroll path shifts the frame by one pixel and only draws the column that enters on the right
+        packed_raster scroll(panels, 1);
+        scroll.draw_text(font, text, text_x(0), 1, raster_op::copy);
+        begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 1; index <= iterations; ++index) {
+            scroll.reset_clip();
+            scroll.scroll(-1, 0);
+            scroll.set_clip(width - 1, 0, 1, 16);
+            auto x = text_x(index);
+            if (x + font.text_width(text) <= width - 1) {
+                x += period; // the next repetition enters
+            }
+            scroll.draw_text(font, text, x, 1, raster_op::copy);
+            asm volatile("" : : "r"(scroll.pixels()) : "memory");
+        }
+        const auto scroll_duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        // all paths end with the text of the last iteration (index iterations - 1 or iterations)
+        const auto redraw_matches = std::equal(packed.begin(), packed.end(), redraw.pixels());
+        redraw.clear();
+        redraw.draw_text(font, text, text_x(iterations), 1, raster_op::copy);
+        redraw.draw_text(font, text, text_x(iterations) + period, 1, raster_op::copy);
+        const auto scroll_matches = std::equal(redraw.frame().begin(), redraw.frame().end(), scroll.frame().begin());
+        matches &= redraw_matches && scroll_matches;
+        for (const auto& path : std::vector<std::tuple<std::string, double, bool>>{
+                 {"bytes + pack", bytes_duration, true},
+                 {"raster redraw", redraw_duration, raster_matches && redraw_matches},
+                 {"raster scroll", scroll_duration, raster_matches && scroll_matches}}) {
+            std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(panels)
+                      << std::setw(16) << std::get<0>(path) << std::setw(14) << std::get<1>(path) / iterations * 1e9
+                      << std::setw(12) << bytes_duration / std::get<1>(path) << std::setw(12)
+                      << (std::get<2>(path) ? "match" : "MISMATCH") << std::endl;
+        }
+    }
+    std::cout << "\n"
+              << std::setw(6) << "panels" << std::setw(8) << "layers" << std::setw(18) << "ns/composite"
+              << std::setw(18) << "ns/unchanged" << std::setw(12) << "reference" << std::endl;
+    for (const uint8_t layers : {1, 4, 16}) {
+        const uint8_t panels = 16;
+        const int32_t width = 32 * panels;
+        const auto iterations = 100 * frames;
+        std::uniform_int_distribution<int32_t> columns(-32, width - 1);
+        std::uniform_int_distribution<int32_t> rows(-8, 15);
+        std::uniform_int_distribution<uint16_t> widths(1, 160);
+        std::uniform_int_distribution<uint16_t> heights(1, 24);
+        std::uniform_int_distribution<int32_t> depths(-2, 2);
+        std::uniform_int_distribution<uint16_t> blends(0, 3);
+        compositor stack(panels, 1);
+        std::vector<uint32_t> identifiers;
+        std::vector<layer_geometry> geometries;
+        std::vector<std::vector<std::vector<uint8_t>>> contents;
+        for (uint8_t index = 0; index < layers; ++index) {
+            identifiers.push_back(stack.add_layer());
+            geometries.push_back(
+                {static_cast<int16_t>(columns(engine)),
+                 static_cast<int16_t>(rows(engine)),
+                 widths(engine),
+                 heights(engine),
+                 depths(engine),
+                 static_cast<blend_op>(blends(engine)),
+                 true});
+            stack.set_geometry(identifiers.back(), geometries.back());
+            contents.emplace_back(
+                4, std::vector<uint8_t>(layer_stride(geometries.back().width) * geometries.back().height));
+            for (auto& content : contents.back()) {
+                for (auto& byte : content) {
+                    byte = static_cast<uint8_t>(distribution(engine));
+                }
+            }
+            stack.set_pixels(identifiers.back(), contents.back()[0].data(), contents.back()[0].size());
+        }
+
+        // each iteration changes one layer, as if a single client sent a frame per display period
+        auto begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < iterations; ++index) {
+            const auto layer = index % layers;
+            const auto& content = contents[layer][(index / layers) % contents[layer].size()];
+            stack.set_pixels(identifiers[layer], content.data(), content.size());
+            asm volatile("" : : "r"(stack.composite().data()) : "memory");
+        }
+        const auto composite_duration =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        begin = std::chrono::steady_clock::now();
+        for (std::size_t index = 0; index < iterations; ++index) {
+            asm volatile("" : : "r"(stack.composite().data()) : "memory");
+        }
+        const auto unchanged_duration =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        // the reference blends one pixel at a time, bottom to top
+        std::vector<std::size_t> order(layers);
+        for (std::size_t index = 0; index < layers; ++index) {
+            order[index] = index;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t first, std::size_t second) {
+            return geometries[first].z < geometries[second].z;
+        });
+        std::vector<uint8_t> image(width * 16, 0);
+        for (const auto layer : order) {
+            const auto& geometry = geometries[layer];
+            const auto& content = contents[layer][((iterations - 1 - layer) / layers) % contents[layer].size()];
+            const auto op = geometry.blend == blend_op::overwrite    ? raster_op::copy
+                            : geometry.blend == blend_op::bitwise_or ? raster_op::bitwise_or
+                            : geometry.blend == blend_op::bitwise_xor ? raster_op::bitwise_xor
+                                                                      : raster_op::bitwise_and;
+            for (int32_t row = 0; row < geometry.height; ++row) {
+                for (int32_t column = 0; column < geometry.width; ++column) {
+                    const auto x = geometry.x + column;
+                    const auto y = geometry.y + row;
+                    if (x < 0 || x >= width || y < 0 || y >= 16) {
+                        continue;
+                    }
+                    const auto source =
+                        (content[row * layer_stride(geometry.width) + column / 8] >> (7 - column % 8)) & 1;
+                    image[y * width + x] = reference_combine(image[y * width + x] != 0, source != 0, op);
+                }
+            }
+        }
+        auto composite_matches = true;
+        const auto& frame = stack.composite();
+        for (int32_t y = 0; y < 16; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                composite_matches &= ((frame[1 + y * width / 8 + x / 8] >> (7 - x % 8)) & 1) == image[y * width + x];
+            }
+        }
+        matches &= composite_matches;
+        std::cout << std::fixed << std::setprecision(1) << std::setw(6) << static_cast<uint32_t>(panels)
+                  << std::setw(8) << static_cast<uint32_t>(layers) << std::setw(18)
+                  << composite_duration / iterations * 1e9 << std::setw(18) << unchanged_duration / iterations * 1e9
+                  << std::setw(12) << (composite_matches ? "match" : "MISMATCH") << std::endl;
+    }
+    std::cout << "\n"
+              << std::setw(16) << "unplugged (ms)" << std::setw(10) << "at" << std::setw(12) << "recoveries"
+              << std::setw(8) << "resets" << std::setw(20) << "longest send (ms)" << std::setw(12) << "result"
+              << std::endl;
+    const auto timeout = recommended_acknowledge_timeout;
+    for (const auto& [unplugged, startup] : std::vector<std::pair<std::chrono::milliseconds, bool>>{
+             {std::chrono::milliseconds(20), false},
+             {std::chrono::milliseconds(300), false},
+             {std::chrono::milliseconds(300), true}}) {
+        simulated_arduino arduino(4, 1);
+        if (startup) {
+            arduino.unplug(unplugged);
+        }
+        // the constructor's blank frames are sent with the timeout, hence a missing Arduino does not block it
+        std::unique_ptr<led_panel<dynamic_layout, dynamic_layout, simulated_gpio>> display;
+        auto recovered = true;
+        std::chrono::nanoseconds longest(0);
+        try {
+            const auto begin = std::chrono::steady_clock::now();
+            display.reset(new led_panel<dynamic_layout, dynamic_layout, simulated_gpio>(
+                4, 1, simulated_gpio(arduino), timeout, 10));
+            longest = std::chrono::steady_clock::now() - begin;
+        } catch (const std::runtime_error&) {
+            recovered = false;
+        }
+        std::vector<uint8_t> content(64 * 4 + 1);
+        for (std::size_t index = 0; recovered && index < 20; ++index) {
+            if (index == 10 && !startup) {
+                arduino.unplug(unplugged);
+            }
+            std::fill(content.begin(), content.end(), static_cast<uint8_t>(index));
+            const auto begin = std::chrono::steady_clock::now();
+            try {
+                display->send(content);
+            } catch (const std::runtime_error&) {
+                recovered = false;
+                break;
+            }
+            longest = std::max(longest, std::chrono::steady_clock::now() - begin);
+        }
+        // a short disconnection only delays the brightness handshake, a long one requires a resync
+        const auto recoveries = display ? display->recoveries() : 0;
+        recovered &= arduino.snapshot().resets == 1 && (recoveries > 0) == (unplugged > timeout);
+        matches &= recovered;
+        std::cout << std::fixed << std::setprecision(1) << std::setw(16) << unplugged.count() << std::setw(10)
+                  << (startup ? "startup" : "frame 10") << std::setw(12) << recoveries << std::setw(8)
+                  << arduino.snapshot().resets << std::setw(20) << std::chrono::duration<double>(longest).count() * 1e3
+                  << std::setw(12)
+                  << (recovered ? "recovered" : "FAILED") << std::endl;
+    }
+    std::cout << "\n"
+              << std::setw(20) << "profile" << std::setw(12) << "p50 (us)" << std::setw(12) << "p99 (us)"
+              << std::setw(12) << "max (us)" << std::setw(18) << "jitter p99 (us)" << std::setw(18)
+              << "jitter max (us)" << std::setw(12) << "recoveries" << std::endl;
+    {
+        // the load threads are created before the real-time profile is applied, hence they keep the default
+        // scheduler, they keep every core busy and evict the caches
+        std::atomic_bool loaded(false);
+        std::atomic_bool running(true);
+        std::vector<std::thread> load;
+        for (uint32_t core = 0; core < std::max(std::thread::hardware_concurrency(), 1u); ++core) {
+            load.emplace_back([&]() {
+                std::vector<uint8_t> memory(1 << 22);
+                uint8_t value = 0;
+                while (running.load(std::memory_order_relaxed)) {
+                    if (!loaded.load(std::memory_order_relaxed)) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        continue;
+                    }
+                    for (std::size_t index = 0; index < memory.size(); index += 64) {
+                        memory[index] = ++value;
+                    }
+                    asm volatile("" : : "r"(memory.data()) : "memory");
+                }
+            });
+        }
+        const auto measure = [&](const std::string& profile) {
+            // the simulated Arduino thread inherits the profile of the calling thread
+            simulated_arduino arduino(16, 1);
+            led_panel display(16, 1, simulated_gpio(arduino), timeout, 10);
+            std::vector<std::vector<uint8_t>> contents(8, std::vector<uint8_t>(64 * 16 + 1));
+            for (auto& content : contents) {
+                for (auto& byte : content) {
+                    byte = static_cast<uint8_t>(distribution(engine));
+                }
+            }
+            // transfers under load without the profile are slow, hence this table uses fewer frames
+            const auto count = std::max<std::size_t>(frames / 4, 10);
+            std::vector<std::chrono::nanoseconds> durations;
+            durations.reserve(count);
+            for (std::size_t index = 0; index < count; ++index) {
+                display.send(contents[index % contents.size()]);
+                durations.push_back(display.transfer_duration());
+            }
+            std::sort(durations.begin(), durations.end());
+
+            // the jitter is the excess over the fastest transfer
+            std::vector<std::chrono::nanoseconds> jitters;
+            for (const auto duration : durations) {
+                jitters.push_back(duration - durations.front());
+            }
+            std::cout << std::fixed << std::setprecision(1) << std::setw(20) << profile << std::setw(12)
+                      << percentile(durations, 0.5) << std::setw(12) << percentile(durations, 0.99) << std::setw(12)
+                      << durations.back().count() / 1e3 << std::setw(18) << percentile(jitters, 0.99)
+                      << std::setw(18) << jitters.back().count() / 1e3 << std::setw(12) << display.recoveries()
+                      << std::endl;
+        };
+        measure("idle");
+        loaded.store(true);
+        measure("loaded");
+        try {
+            apply_realtime_profile({true, 50, 0});
+            measure("loaded, real-time");
+            sched_param parameters{};
+            pthread_setschedparam(pthread_self(), SCHED_OTHER, &parameters);
+            munlockall();
+        } catch (const std::runtime_error& error) {
+            std::cout << std::setw(20) << "loaded, real-time" << "  unavailable: " << error.what() << std::endl;
+        }
+        running.store(false);
+        for (auto& thread : load) {
+            thread.join();
+        }
+    }
+    return matches ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include "clip.hpp"
+#include "command_line.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    uint8_t width = 1;
+    uint8_t height = 1;
+    std::string path;
+    uint32_t frame_rate_numerator = 30;
+    uint32_t frame_rate_denominator = 1;
+    auto order = clip_order::wire;
+    try {
+        if (argc < 4) {
+            throw std::runtime_error("bad number of arguments");
+        }
+        width = string_to_uint8("width", argv[1]);
+        height = string_to_uint8("height", argv[2]);
+        path = argv[3];
+        for (int index = 4; index < argc; ++index) {
+            const std::string option(argv[index]);
+            if (option == "--fps") {
+                const auto value = option_value(argc, argv, index);
+                const auto separator = value.find('/');
+                frame_rate_numerator = static_cast<uint32_t>(stoul(value.substr(0, separator)));
+                frame_rate_denominator =
+                    separator == std::string::npos ? 1 : static_cast<uint32_t>(stoul(value.substr(separator + 1)));
+            } else if (option == "--row-major") {
+                order = clip_order::row_major;
+            } else {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n"
+                  << "syntax: led_panel_clip width height output [options] < stream\n"
+                  << "    converts a led_panel_sink input stream (brightness and packed pixels per frame) to a clip\n"
+                  << "    width and height are a number of panels, not a number of pixels\n"
+                  << "options:\n"
+                  << "    --fps rate                     clip frame rate, an integer or a ratio such as 30000/1001\n"
+                  << "                                   (defaults to 30)\n"
+                  << "    --row-major                    store the pixels in frame order instead of wire order"
+                  << std::endl;
+        return 1;
+    }
+    try {
+        clip_writer writer(path, width, height, order, frame_rate_numerator, frame_rate_denominator);
+        std::vector<uint8_t> frame(64 * width * height + 1);
+        while (std::cin.read(reinterpret_cast<char*>(frame.data()), frame.size())) {
+            writer.write(frame[0], frame.data() + 1);
+        }
+        if (std::cin.gcount() > 0) {
+            std::cerr << "ignored a truncated frame (" << std::cin.gcount() << " bytes) at the end of the stream"
+                      << std::endl;
+        }
+        std::cerr << "wrote " << writer.frames() << " frames to '" << path << "'" << std::endl;
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include "calibration.hpp"
+#include "command_line.hpp"
+#include "compositor.hpp"
+#include "led_panel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+/// stop is set by SIGINT and SIGTERM.
+volatile std::sig_atomic_t stop = 0;
+
+/// client holds the state of a connection.
+/// buffer accumulates the received bytes until a message (header and payload) is complete.
+struct client {
+    int32_t file_descriptor;
+    uint32_t layer;
+    std::vector<uint8_t> buffer;
+    std::size_t size;
+};
+
+/// read_size is the largest number of bytes read from a client at once.
+constexpr std::size_t read_size = 1 << 16;
+
+/// handle_messages applies the complete messages in the client's buffer, and keeps the bytes of the last incomplete
+/// message. It throws if a message is invalid.
+void handle_messages(compositor& layers, client& connection) {
+    std::size_t offset = 0;
+    while (connection.size - offset >= sizeof(compositor_message)) {
+        compositor_message message;
+        std::memcpy(&message, connection.buffer.data() + offset, sizeof(message));
+        if (message.type == compositor_message_type::geometry) {
+            if (message.size != 0) {
+                throw std::logic_error("geometry messages must not have a payload");
+            }
+            layers.set_geometry(
+                connection.layer,
+                {message.x,
+                 message.y,
+                 message.width,
+                 message.height,
+                 message.z,
+                 static_cast<blend_op>(message.blend),
+                 message.visible != 0});
+            offset += sizeof(message);
+        } else if (message.type == compositor_message_type::pixels) {
+            if (message.size > layer_stride(compositor::maximum_size) * compositor::maximum_size) {
+                throw std::logic_error("the pixels message is too large");
+            }
+            if (connection.size - offset < sizeof(message) + message.size) {
+                // the buffer grows to fit the message
+                connection.buffer.resize(
+                    std::max(connection.buffer.size(), sizeof(message) + message.size + read_size));
+                break;
+            }
+            layers.set_pixels(connection.layer, connection.buffer.data() + offset + sizeof(message), message.size);
+            offset += sizeof(message) + message.size;
+        } else {
+            throw std::logic_error("unknown message type " + std::to_string(static_cast<uint32_t>(message.type)));
+        }
+    }
+    std::copy(
+        connection.buffer.begin() + offset, connection.buffer.begin() + connection.size, connection.buffer.begin());
+    connection.size -= offset;
+}
+
+int main(int argc, char* argv[]) {
+    uint8_t width = 1;
+    uint8_t height = 1;
+    std::string path;
+    uint8_t brightness = 255;
+    auto to_stdout = false;
+    auto deltas = false;
+    auto buffer_depth = led_panel<>::max_buffer_depth;
+    try {
+        if (argc < 4) {
+            throw std::runtime_error("bad number of arguments");
+        }
+        width = string_to_uint8("width", argv[1]);
+        height = string_to_uint8("height", argv[2]);
+        path = argv[3];
+        for (int index = 4; index < argc; ++index) {
+            const std::string option(argv[index]);
+            if (option == "--brightness") {
+                brightness = string_to_uint8("brightness", option_value(argc, argv, index));
+            } else if (option == "--stdout") {
+                to_stdout = true;
+            } else if (option == "--delta") {
+                deltas = true;
+            } else if (option == "--buffer-depth") {
+                buffer_depth = string_to_uint8("buffer depth", option_value(argc, argv, index));
+                if (buffer_depth == 0 || buffer_depth > led_panel<>::max_buffer_depth) {
+                    throw std::out_of_range("the buffer depth must be in the range [1, 7]");
+                }
+            } else {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n"
+                  << "syntax: led_panel_compositor width height socket [options]\n"
+                  << "    owns the display and composites the layers of the clients connected to the Unix domain\n"
+                  << "    socket (see compositor.hpp for the protocol), at most once per display period\n"
+                  << "    width and height are a number of panels, not a number of pixels\n"
+                  << "options:\n"
+                  << "    --brightness value             frames brightness (defaults to 255)\n"
+                  << "    --stdout                       write the frames to the standard output (led_panel_sink\n"
+                  << "                                   input format) instead of the display\n"
+                  << "    --delta                        transmit only the rows that changed since the previous frame\n"
+                  << "                                   (requires the delta firmware)\n"
+                  << "    --buffer-depth frames          number of frames queued by the Arduino behind the displayed\n"
+                  << "                                   one, from 1 to 7 (defaults to 7)"
+                  << std::endl;
+        return 1;
+    }
+    auto listener = -1;
+    try {
+        compositor layers(width, height);
+        layers.set_brightness(brightness);
+        std::unique_ptr<led_panel<>> display;
+        if (!to_stdout) {
+            display.reset(new led_panel<>(width, height));
+            auto timing = default_handshake_timing;
+            if (load_timing(default_timing_path(), device_identifier(), timing)) {
+                display->set_timing(timing);
+            }
+            display->send_deltas(deltas);
+            display->set_buffer_depth(buffer_depth);
+        }
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error(
+                "the socket path must be shorter than " + std::to_string(sizeof(address.sun_path)) + " characters");
+        }
+        address.sun_family = AF_UNIX;
+        std::copy(path.begin(), path.end(), address.sun_path);
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            throw std::runtime_error("creating the socket failed");
+        }
+        if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            // a compositor that did not exit cleanly leaves the socket file behind, unlike a running one
+            auto stale = false;
+            if (errno == EADDRINUSE) {
+                const auto probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                stale = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+                        && errno == ECONNREFUSED;
+                ::close(probe);
+            }
+            if (!stale || unlink(path.c_str()) < 0
+                || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+                ::close(listener);
+                listener = -1;
+                throw std::runtime_error("binding '" + path + "' failed (is another compositor running?)");
+            }
+        }
+        if (listen(listener, 16) < 0) {
+            throw std::runtime_error("listening on '" + path + "' failed");
+        }
+        struct sigaction action {};
+        action.sa_handler = [](int) { stop = 1; };
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+
+        std::vector<client> clients;
+        std::vector<pollfd> file_descriptors;
+        uint64_t frames = 0;
+        uint64_t connections = 0;
+        auto next_tick = std::chrono::steady_clock::now();
+        while (stop == 0) {
+            file_descriptors.assign(1, {listener, POLLIN, 0});
+            for (const auto& connection : clients) {
+                file_descriptors.push_back({connection.file_descriptor, POLLIN, 0});
+            }
+            const auto wait = std::max(next_tick - std::chrono::steady_clock::now(), std::chrono::nanoseconds(0));
+            const timespec timeout{
+                static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(wait).count()),
+                static_cast<long>((wait % std::chrono::seconds(1)).count())};
+            if (ppoll(file_descriptors.data(), file_descriptors.size(), &timeout, nullptr) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("poll failed");
+            }
+            if (file_descriptors[0].revents & POLLIN) {
+                for (;;) {
+                    const auto file_descriptor = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (file_descriptor < 0) {
+                        break;
+                    }
+                    clients.push_back({file_descriptor, layers.add_layer(), std::vector<uint8_t>(read_size), 0});
+                    ++connections;
+                }
+            }
+            // file_descriptors[index + 1] is associated with clients[index], new clients are polled next iteration
+            std::size_t index = 0;
+            for (std::size_t polled = 1; polled < file_descriptors.size(); ++polled) {
+                auto& connection = clients[index];
+                auto closed = false;
+                if (file_descriptors[polled].revents != 0) {
+                    const auto bytes = ::read(
+                        connection.file_descriptor,
+                        connection.buffer.data() + connection.size,
+                        connection.buffer.size() - connection.size);
+                    if (bytes > 0) {
+                        connection.size += bytes;
+                        try {
+                            handle_messages(layers, connection);
+                        } catch (const std::logic_error& error) {
+                            std::cerr << "client " << connection.layer << ": " << error.what() << std::endl;
+                            closed = true;
+                        }
+                    } else if (bytes == 0 || (errno != EINTR && errno != EAGAIN)) {
+                        closed = true;
+                    }
+                }
+                if (closed) {
+                    ::close(connection.file_descriptor);
+                    layers.remove_layer(connection.layer);
+                    clients.erase(clients.begin() + index);
+                } else {
+                    ++index;
+                }
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= next_tick) {
+                if (layers.changed()) {
+                    const auto& frame = layers.composite();
+                    if (display) {
+                        display->send(frame);
+                    } else {
+                        write_all(frame.data(), frame.size());
+                    }
+                    ++frames;
+                }
+                next_tick += display_period;
+                if (next_tick < now) {
+                    next_tick = now + display_period;
+                }
+            }
+        }
+        for (const auto& connection : clients) {
+            ::close(connection.file_descriptor);
+        }
+        ::close(listener);
+        unlink(path.c_str());
+        std::cerr << "composited " << frames << " frames for " << connections << " clients" << std::endl;
+    } catch (const std::exception& error) {
+        if (listener >= 0) {
+            ::close(listener);
+            unlink(path.c_str());
+        }
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "calibration.hpp"
+#include "command_line.hpp"
+#include "event_renderer.hpp"
+#include "led_panel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/// batch_size is the largest number of events read at once.
+constexpr std::size_t batch_size = 1 << 16;
+
+int main(int argc, char* argv[]) {
+    uint8_t width = 1;
+    uint8_t height = 1;
+    std::string input;
+    uint16_t sensor_width = 0;
+    uint16_t sensor_height = 0;
+    auto rendering = event_rendering::window;
+    uint64_t time_constant = 20000;
+    auto polarity = event_polarity::both;
+    auto method = dithering::ordered;
+    uint64_t frame_period = 9984;
+    uint8_t brightness = 255;
+    auto to_stdout = false;
+    auto buffer_depth = led_panel<>::max_buffer_depth;
+    try {
+        if (argc < 3) {
+            throw std::runtime_error("bad number of arguments");
+        }
+        width = string_to_uint8("width", argv[1]);
+        height = string_to_uint8("height", argv[2]);
+        for (int index = 3; index < argc; ++index) {
+            const std::string option(argv[index]);
+            if (option == "--input") {
+                input = option_value(argc, argv, index);
+            } else if (option == "--sensor") {
+                sensor_width = static_cast<uint16_t>(stoul(option_value(argc, argv, index)));
+                sensor_height = static_cast<uint16_t>(stoul(option_value(argc, argv, index)));
+            } else if (option == "--window") {
+                rendering = event_rendering::window;
+                time_constant = stoull(option_value(argc, argv, index));
+            } else if (option == "--decay") {
+                rendering = event_rendering::decay;
+                time_constant = stoull(option_value(argc, argv, index));
+            } else if (option == "--polarity") {
+                const auto value = option_value(argc, argv, index);
+                if (value == "both") {
+                    polarity = event_polarity::both;
+                } else if (value == "on") {
+                    polarity = event_polarity::on;
+                } else if (value == "off") {
+                    polarity = event_polarity::off;
+                } else {
+                    throw std::runtime_error("unknown polarity '" + value + "'");
+                }
+            } else if (option == "--dithering") {
+                method = string_to_dithering(option_value(argc, argv, index));
+            } else if (option == "--frame-period") {
+                frame_period = stoull(option_value(argc, argv, index));
+            } else if (option == "--brightness") {
+                brightness = string_to_uint8("brightness", option_value(argc, argv, index));
+            } else if (option == "--stdout") {
+                to_stdout = true;
+            } else if (option == "--buffer-depth") {
+                buffer_depth = string_to_uint8("buffer depth", option_value(argc, argv, index));
+                if (buffer_depth == 0 || buffer_depth > led_panel<>::max_buffer_depth) {
+                    throw std::out_of_range("the buffer depth must be in the range [1, 7]");
+                }
+            } else {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+        if (sensor_width == 0) {
+            sensor_width = 32 * width;
+            sensor_height = 16 * height;
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n"
+                  << "syntax: led_panel_events width height [options] < events\n"
+                  << "    renders an address event stream (13 bytes per event: t (uint64, us), x (uint16), y (uint16)\n"
+                  << "    and on (uint8), little-endian) at the display rate, see event_renderer.hpp\n"
+                  << "    without input, frames keep advancing with the wall clock\n"
+                  << "    width and height are a number of panels, not a number of pixels\n"
+                  << "options:\n"
+                  << "    --input path                   read the events from a file instead of the standard input\n"
+                  << "    --sensor width height          sensor size in pixels, scaled to the display (defaults to\n"
+                  << "                                   the display size)\n"
+                  << "    --window us                    light the pixels with an event in the last us microseconds\n"
+                  << "                                   (default, 20000)\n"
+                  << "    --decay us                     dim the pixels exponentially with the given time constant\n"
+                  << "    --polarity polarity            both (default), on or off\n"
+                  << "    --dithering method             threshold, ordered (default) or error-diffusion, used by\n"
+                  << "                                   --decay\n"
+                  << "    --frame-period us              event time between frames (defaults to 9984, the display\n"
+                  << "                                   period)\n"
+                  << "    --brightness value             frames brightness (defaults to 255)\n"
+                  << "    --stdout                       write the frames to the standard output (led_panel_sink\n"
+                  << "                                   input format) instead of the display\n"
+                  << "    --buffer-depth frames          number of frames queued by the Arduino behind the displayed\n"
+                  << "                                   one, from 1 to 7 (defaults to 7)"
+                  << std::endl;
+        return 1;
+    }
+    try {
+        event_renderer renderer(
+            width, height, sensor_width, sensor_height, rendering, time_constant, polarity, frame_period, method);
+        renderer.set_brightness(brightness);
+        std::unique_ptr<led_panel<>> display;
+        if (!to_stdout) {
+            display.reset(new led_panel<>(width, height));
+            auto timing = default_handshake_timing;
+            if (load_timing(default_timing_path(), device_identifier(), timing)) {
+                display->set_timing(timing);
+            }
+            display->set_buffer_depth(buffer_depth);
+        }
+        auto file_descriptor = STDIN_FILENO;
+        if (!input.empty()) {
+            file_descriptor = open(input.c_str(), O_RDONLY);
+            if (file_descriptor < 0) {
+                throw std::runtime_error("'" + input + "' could not be opened");
+            }
+        }
+        const auto frame_size = 64u * width * height + 1;
+        std::chrono::steady_clock::duration input_duration(0);
+        std::chrono::steady_clock::duration output_duration(0);
+        const auto handle_frame = [&](const uint8_t* frame) {
+            const auto output_begin = std::chrono::steady_clock::now();
+            if (display) {
+                display->send(frame);
+            } else {
+                write_all(frame, frame_size);
+            }
+            output_duration += std::chrono::steady_clock::now() - output_begin;
+        };
+
+        // the buffer keeps the bytes of an incomplete record at the end of a read
+        std::vector<uint8_t> buffer(batch_size * event_record_size);
+        std::size_t size = 0;
+        // without input, the event time follows the wall clock from the last read, hence lit pixels expire on time
+        const auto poll_timeout = static_cast<int>(std::max<uint64_t>(frame_period / 1000, 1));
+        auto anchored = false;
+        uint64_t anchor_time = 0;
+        std::chrono::steady_clock::time_point anchor_wall;
+        const auto begin = std::chrono::steady_clock::now();
+        for (;;) {
+            const auto input_begin = std::chrono::steady_clock::now();
+            pollfd descriptor{file_descriptor, POLLIN, 0};
+            const auto ready = poll(&descriptor, 1, poll_timeout);
+            if (ready == 0) {
+                input_duration += std::chrono::steady_clock::now() - input_begin;
+                if (anchored) {
+                    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - anchor_wall);
+                    renderer.advance(anchor_time + elapsed.count(), handle_frame);
+                }
+                continue;
+            }
+            const auto bytes = ready < 0 ? -1 : ::read(file_descriptor, buffer.data() + size, buffer.size() - size);
+            input_duration += std::chrono::steady_clock::now() - input_begin;
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes < 0) {
+                throw std::runtime_error("reading the events failed");
+            }
+            if (bytes == 0) {
+                break;
+            }
+            size += bytes;
+            const auto count = size / event_record_size;
+            renderer.process(buffer.data(), count, handle_frame);
+            std::copy(buffer.begin() + count * event_record_size, buffer.begin() + size, buffer.begin());
+            size -= count * event_record_size;
+            if (count > 0) {
+                anchored = true;
+                anchor_time = renderer.time();
+                anchor_wall = std::chrono::steady_clock::now();
+            }
+        }
+        const auto duration = std::chrono::steady_clock::now() - begin;
+        if (file_descriptor != STDIN_FILENO) {
+            ::close(file_descriptor);
+        }
+        if (size > 0) {
+            std::cerr << "ignored a truncated event (" << size << " bytes) at the end of the stream" << std::endl;
+        }
+        // the processing duration excludes the input and output waits
+        std::cerr << "rendered " << renderer.events() << " events as " << renderer.frames() << " frames ("
+                  << renderer.events()
+                         / std::chrono::duration<double>(duration - input_duration - output_duration).count()
+                  << " events/s, " << renderer.events() / std::chrono::duration<double>(duration).count()
+                  << " events/s including input and output)" << std::endl;
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
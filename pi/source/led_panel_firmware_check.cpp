@@ -0,0 +1,329 @@
+#include "avr_host.h"
+#include "calibration.hpp"
+#include "led_panel.hpp"
+#include <atomic>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+
+/// host_firmware runs the host build of the firmware (see arduino/host/avr_host.h).
+/// A thread calls the timer interrupt every display_period / 1024, as the Arduino's Timer0.
+class host_firmware {
+    public:
+    host_firmware() : _running(true) {
+        avr_host_start();
+        _interrupts = std::thread([this]() {
+            const auto period = display_period / 1024;
+            auto next = std::chrono::steady_clock::now() + period;
+            while (_running.load(std::memory_order_relaxed)) {
+                for (auto now = std::chrono::steady_clock::now(); now >= next; next += period) {
+                    avr_host_interrupt();
+                }
+                if (std::thread::hardware_concurrency() < 3) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    host_firmware(const host_firmware&) = delete;
+    host_firmware(host_firmware&& other) = delete;
+    host_firmware& operator=(const host_firmware&) = delete;
+    host_firmware& operator=(host_firmware&& other) = delete;
+    virtual ~host_firmware() {
+        _running.store(false, std::memory_order_relaxed);
+        _interrupts.join();
+        avr_host_stop();
+    }
+
+    protected:
+    std::atomic_bool _running;
+    std::thread _interrupts;
+};
+
+/// firmware_gpio is a led_panel register backend wired to the host build of the firmware.
+/// The data pins and the request pin drive PIND and PINC, and the acknowledge pin reads PORTC.
+class firmware_gpio {
+    public:
+    firmware_gpio() : _level(0), _corruption(0), _yield(std::thread::hardware_concurrency() < 3) {}
+
+    /// set_corruption flips the given PIND bits, to emulate a data line that the firmware reads incorrectly.
+    void set_corruption(uint8_t corruption) {
+        _corruption = corruption;
+    }
+
+    /// write stores a value in the given register.
+    void write(uint8_t offset, uint32_t value) {
+        if (offset == set_offset) {
+            _level |= value;
+        } else if (offset == clear_offset) {
+            _level &= ~value;
+        } else {
+            return;
+        }
+        uint8_t pind = 0;
+        for (uint8_t bit = 0; bit < 8; ++bit) {
+            pind |= static_cast<uint8_t>(((_level >> bit_to_gpio[bit]) & 1) << bit);
+        }
+        avr_host_set_pins(pind ^ _corruption, static_cast<uint8_t>(((_level >> request_pin) & 1) << pi_request_pin));
+    }
+
+    /// read loads the value of the given register.
+    uint32_t read(uint8_t offset) {
+        if (offset != level_offset) {
+            return 0;
+        }
+        if (_yield) {
+            std::this_thread::yield();
+        }
+        return _level | (((avr_host_portc() >> pi_acknowledge_pin) & 1u) << acknowledge_pin);
+    }
+
+    protected:
+    static constexpr uint8_t set_offset = 7;
+    static constexpr uint8_t clear_offset = 10;
+    static constexpr uint8_t level_offset = 13;
+    static constexpr uint32_t request_pin = 27;
+    static constexpr uint32_t acknowledge_pin = 22;
+    static constexpr uint8_t pi_request_pin = 1;
+    static constexpr uint8_t pi_acknowledge_pin = 2;
+
+    /// bit_to_gpio associates the Arduino's PIND bits with the Raspberry Pi GPIOs (see simulated_arduino.hpp).
+    static constexpr std::array<uint8_t, 8> bit_to_gpio = {20, 21, 26, 16, 19, 13, 6, 5};
+
+    uint32_t _level;
+    uint8_t _corruption;
+    bool _yield;
+};
+
+/// unpaced_led_panel skips the low-latency pacing, to check that the firmware enforces the buffer depth.
+class unpaced_led_panel : public led_panel<dynamic_layout, dynamic_layout, firmware_gpio> {
+    public:
+    using led_panel<dynamic_layout, dynamic_layout, firmware_gpio>::led_panel;
+
+    /// send_unpaced transmits a frame as soon as possible (the handshake waits for the firmware).
+    void send_unpaced(const std::vector<uint8_t>& frame) {
+        _presentation_times.fill(std::chrono::steady_clock::time_point());
+        send(frame);
+    }
+};
+
+/// committed_slot_matches returns true if the last committed slot holds the given frame.
+/// The brightness is stored as is, and the pixels are inverted and in wire order.
+bool committed_slot_matches(const std::vector<uint8_t>& frame, const std::vector<uint16_t>& wire_order) {
+    const auto slot = avr_host_slot(avr_host_committed_slot());
+    if (slot[0] != frame[0]) {
+        return false;
+    }
+    for (std::size_t index = 0; index < wire_order.size(); ++index) {
+        if (slot[index + 1] != static_cast<uint8_t>(~frame[wire_order[index] + 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    constexpr uint8_t width = 2;
+    constexpr uint8_t height = 2;
+    if (avr_host_frame_size() != 64 * width * height) {
+        std::cerr << "the firmware was compiled with frame_size " << avr_host_frame_size() << " instead of "
+                  << 64 * width * height << std::endl;
+        return 1;
+    }
+    const auto wire_order = dynamic_wire_order(width, height);
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<uint16_t> distribution(0, 255);
+    std::vector<uint8_t> frame(64 * width * height + 1);
+    for (auto& byte : frame) {
+        byte = static_cast<uint8_t>(distribution(engine));
+    }
+
+    // change_blocks modifies count random delta blocks (16 wire bytes) of the frame
+    const auto change_blocks = [&](uint16_t count) {
+        std::uniform_int_distribution<uint16_t> blocks(0, static_cast<uint16_t>(wire_order.size() / 16 - 1));
+        for (uint16_t change = 0; change < count; ++change) {
+            const auto block = blocks(engine);
+            for (uint16_t index = block * 16; index < (block + 1) * 16; ++index) {
+                frame[wire_order[index] + 1] = static_cast<uint8_t>(distribution(engine));
+            }
+        }
+        frame[0] = static_cast<uint8_t>(distribution(engine));
+    };
+    auto failures = 0;
+
+    // check sends frames and compares the committed slot with each of them
+    const auto check = [&](const std::string& name, std::size_t frames, const std::function<void(std::size_t)>& send) {
+        std::size_t mismatches = 0;
+        std::string error;
+        const auto begin = std::chrono::steady_clock::now();
+        try {
+            for (std::size_t index = 0; index < frames; ++index) {
+                send(index);
+                if (!committed_slot_matches(frame, wire_order)) {
+                    ++mismatches;
+                }
+            }
+        } catch (const std::runtime_error& exception) {
+            error = exception.what();
+        }
+        const auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << std::setw(36) << std::left << name << std::setw(8) << std::right << frames << std::setw(12)
+                  << std::fixed << std::setprecision(1) << frames / duration << " frames/s    "
+                  << (!error.empty()      ? error
+                      : mismatches == 0 ? "ok"
+                                        : std::to_string(mismatches) + " MISMATCHES")
+                  << std::endl;
+        if (!error.empty() || mismatches > 0) {
+            ++failures;
+        }
+    };
+    std::cout << std::setw(36) << std::left << "scenario" << std::setw(8) << std::right << "frames" << std::setw(21)
+              << "rate" << std::setw(10) << "result" << std::endl;
+    host_firmware firmware;
+    {
+        unpaced_led_panel display(width, height, firmware_gpio(), std::chrono::milliseconds(500));
+        check("full frames", 50, [&](std::size_t) {
+            change_blocks(64);
+            display.send(frame);
+        });
+        display.send_deltas(true);
+        check("delta frames, 0 to 3 changed blocks", 300, [&](std::size_t index) {
+            change_blocks(static_cast<uint16_t>(index % 4));
+            display.send(frame);
+        });
+        check("delta frames, every block changed", 50, [&](std::size_t) {
+            change_blocks(256);
+            display.send(frame);
+        });
+        check("delta planes", 100, [&](std::size_t index) {
+            change_blocks(1);
+            display.send_plane(frame[0], frame.data() + 1, index % 3 == 2);
+        });
+        check("delta frames after 50 ms idle", 10, [&](std::size_t) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            change_blocks(1);
+            display.send(frame);
+        });
+        check("delta frames after 80 ms idle", 10, [&](std::size_t) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(80));
+            change_blocks(1);
+            display.send(frame);
+        });
+        check("delta frames after resync", 20, [&](std::size_t index) {
+            if (index % 5 == 0) {
+                display.resync();
+            }
+            change_blocks(2);
+            display.send(frame);
+        });
+        display.send_deltas(false);
+        check("full frames after deltas", 20, [&](std::size_t) {
+            change_blocks(2);
+            display.send(frame);
+        });
+        for (const uint8_t depth : {1, 2}) {
+            display.set_buffer_depth(depth);
+            for (const auto paced : {true, false}) {
+                check(
+                    std::string(paced ? "paced" : "unpaced") + " frames, buffer depth " + std::to_string(depth),
+                    50,
+                    [&](std::size_t index) {
+                        change_blocks(4);
+                        if (paced) {
+                            display.send(frame);
+                        } else {
+                            display.send_unpaced(frame);
+                        }
+                        // the first frame after set_buffer_depth is received with the previous depth
+                        if (index > 0 && avr_host_queued_slots() > depth) {
+                            throw std::runtime_error(
+                                "the firmware queued more than " + std::to_string(depth) + " frames");
+                        }
+                    });
+            }
+        }
+        display.set_buffer_depth(display.max_buffer_depth);
+        check("verified frames", 20, [&](std::size_t) {
+            change_blocks(64);
+            if (!display.verify(frame)) {
+                throw std::runtime_error("checksum mismatch");
+            }
+        });
+        check("verified frames, corrupted data line", 10, [&](std::size_t) {
+            change_blocks(64);
+            display.gpio().set_corruption(1 << 7);
+            const auto verified = display.verify(frame);
+            display.gpio().set_corruption(0);
+            display.send(frame);
+            if (verified) {
+                throw std::runtime_error("the checksum missed a corrupted frame");
+            }
+        });
+        display.send_deltas(true);
+        check("verified delta frames", 20, [&](std::size_t) {
+            change_blocks(2);
+            if (!display.verify(frame)) {
+                throw std::runtime_error("checksum mismatch");
+            }
+        });
+        check("delta frames before a new host", 10, [&](std::size_t) {
+            change_blocks(1);
+            display.send(frame);
+        });
+    }
+    {
+        // a new led_panel (for instance a new led_panel_sink process) does not know that the firmware expects deltas
+        led_panel<dynamic_layout, dynamic_layout, firmware_gpio> display(
+            width, height, firmware_gpio(), std::chrono::milliseconds(500));
+        check("full frames from a new host", 20, [&](std::size_t) {
+            change_blocks(2);
+            display.send(frame);
+        });
+    }
+    {
+        // a 1 us acknowledge latency with 1 ns nops yields a 7 nop margin, hence the delays are trimmed below the
+        // defaults, whereas a large latency is capped by the defaults
+        const std::chrono::duration<double, std::nano> nop(1.0);
+        const auto margin = latency_margin(std::chrono::microseconds(1), nop);
+        const auto large_margin = latency_margin(std::chrono::milliseconds(1), nop);
+        const std::array<std::tuple<const char*, uint16_t, uint16_t>, 5> cases = {{
+            {"zero passing delay, 1 us latency", calibrated_delay(0, margin, default_handshake_timing.setup), 7},
+            {"zero passing delay, no latency", calibrated_delay(0, 0, default_handshake_timing.setup), 1},
+            {"passing delay 3, 1 us latency", calibrated_delay(3, margin, default_handshake_timing.hold), 10},
+            {"passing delay 12, 1 us latency", calibrated_delay(12, margin, default_handshake_timing.hold), 24},
+            {"zero passing delay, 1 ms latency",
+             calibrated_delay(0, large_margin, default_handshake_timing.setup),
+             default_handshake_timing.setup},
+        }};
+        for (const auto& calibration_case : cases) {
+            std::cout << "calibrated delay, " << std::get<0>(calibration_case) << ": "
+                      << std::get<1>(calibration_case);
+            if (std::get<1>(calibration_case) != std::get<2>(calibration_case)) {
+                std::cout << "    EXPECTED " << std::get<2>(calibration_case) << std::endl;
+                ++failures;
+            } else {
+                std::cout << "    ok" << std::endl;
+            }
+        }
+    }
+    {
+        // the host firmware accepts any timing, but its acknowledge latency is large enough for the margin to reach
+        // the defaults (see the checks above for the trimmed delays), hence this only checks that calibration runs
+        led_panel<dynamic_layout, dynamic_layout, firmware_gpio> display(width, height);
+        const auto result = calibrate(display, 6);
+        std::cout << "calibration: setup " << result.timing.setup << ", hold " << result.timing.hold
+                  << ", acknowledge latency " << result.acknowledge_latency.count() << " ns";
+        if (result.timing.setup == 0 || result.timing.hold == 0) {
+            std::cout << "    NO MARGIN" << std::endl;
+            ++failures;
+        } else {
+            std::cout << "    ok" << std::endl;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "calibration.hpp"
+#include "clip.hpp"
+#include "command_line.hpp"
+#include "led_panel.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+int main(int argc, char* argv[]) {
+    std::string path;
+    auto loop = false;
+    uint64_t seek = 0;
+    double frame_rate = -1.0;
+    auto override_timing = false;
+    auto timing = default_handshake_timing;
+    try {
+        if (argc < 2) {
+            throw std::runtime_error("bad number of arguments");
+        }
+        path = argv[1];
+        for (int index = 2; index < argc; ++index) {
+            const std::string option(argv[index]);
+            if (option == "--loop") {
+                loop = true;
+            } else if (option == "--seek") {
+                seek = stoull(option_value(argc, argv, index));
+            } else if (option == "--fps") {
+                frame_rate = stod(option_value(argc, argv, index));
+                if (frame_rate < 0.0) {
+                    throw std::out_of_range("the frame rate must be positive");
+                }
+            } else if (option == "--timing") {
+                override_timing = true;
+                timing.setup = static_cast<uint16_t>(stoul(option_value(argc, argv, index)));
+                timing.hold = static_cast<uint16_t>(stoul(option_value(argc, argv, index)));
+            } else {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n"
+                  << "syntax: led_panel_play clip [options]\n"
+                  << "    clip is a file created with led_panel_clip (see clip.hpp)\n"
+                  << "options:\n"
+                  << "    --loop                         restart from the first frame after the last one\n"
+                  << "    --seek frame                   start from the given frame index\n"
+                  << "    --fps rate                     play at the given frame rate instead of the clip's, 0 sends\n"
+                  << "                                   frames as fast as the display accepts them\n"
+                  << "    --timing setup hold            use the given handshake delays (number of nops) instead of\n"
+                  << "                                   the saved calibration"
+                  << std::endl;
+        return 1;
+    }
+    try {
+        const clip animation(path);
+        const auto& header = animation.header();
+        if (animation.frames() == 0) {
+            throw std::runtime_error("'" + path + "' has no frames");
+        }
+        if (seek >= animation.frames()) {
+            throw std::out_of_range(
+                "the seek index must be smaller than the number of frames (" + std::to_string(animation.frames())
+                + ")");
+        }
+        if (frame_rate < 0.0) {
+            frame_rate = animation.frame_rate();
+        }
+        led_panel display(header.width, header.height);
+        if (override_timing || load_timing(default_timing_path(), device_identifier(), timing)) {
+            display.set_timing(timing);
+        }
+        const auto period = frame_rate == 0.0 ? std::chrono::steady_clock::duration(0)
+                                              : std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double>(1.0 / frame_rate));
+        uint64_t played = 0;
+        uint64_t late = 0;
+        const auto begin = std::chrono::steady_clock::now();
+        auto next = begin;
+        for (auto index = seek;;) {
+            if (period.count() > 0) {
+                const auto now = std::chrono::steady_clock::now();
+                if (now > next + period) {
+                    // the display fell behind by more than a frame, restart the schedule instead of catching up
+                    ++late;
+                    next = now;
+                } else {
+                    std::this_thread::sleep_until(next);
+                }
+                next += period;
+            }
+            const auto record = animation.record(index);
+            if (header.order == clip_order::wire) {
+                display.send_wire_ordered(record[0], record + 1);
+            } else {
+                display.send(record);
+            }
+            ++played;
+            ++index;
+            if (index == animation.frames()) {
+                if (!loop) {
+                    break;
+                }
+                index = 0;
+            }
+        }
+        std::cerr << "played " << played << " frames at "
+                  << played / std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count()
+                  << " frames/s (" << late << " late)" << std::endl;
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
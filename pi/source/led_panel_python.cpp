@@ -0,0 +1,806 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "calibration.hpp"
+#include "command_line.hpp"
+#include "grayscale_packer.hpp"
+#include "led_panel.hpp"
+#include "packed_raster.hpp"
+#include <array>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+/// display_object is the Python representation of a led_panel.
+/// The methods release the GIL while they use the panel, mutex serializes them.
+struct display_object {
+    PyObject_HEAD
+    led_panel<>* panel;
+    std::mutex* mutex;
+};
+
+/// set_python_error converts a C++ exception to a Python exception.
+/// std::logic_error becomes a ValueError, other exceptions become a RuntimeError.
+static void set_python_error(std::exception_ptr exception) {
+    try {
+        std::rethrow_exception(exception);
+    } catch (const std::logic_error& error) {
+        PyErr_SetString(PyExc_ValueError, error.what());
+    } catch (const std::exception& error) {
+        PyErr_SetString(PyExc_RuntimeError, error.what());
+    } catch (...) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown C++ exception");
+    }
+}
+
+/// call_without_gil runs function with the GIL released and the display's mutex locked.
+/// It returns false and sets a Python exception if the display is not initialized or if function throws.
+template <typename Function>
+static bool call_without_gil(display_object* self, Function function) {
+    if (self->panel == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "the display is not initialized");
+        return false;
+    }
+    std::exception_ptr exception;
+    Py_BEGIN_ALLOW_THREADS;
+    try {
+        std::lock_guard<std::mutex> lock(*self->mutex);
+        function(*self->panel);
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS;
+    if (exception) {
+        set_python_error(exception);
+        return false;
+    }
+    return true;
+}
+
+static PyObject* display_new(PyTypeObject* type, PyObject*, PyObject*) {
+    auto self = reinterpret_cast<display_object*>(type->tp_alloc(type, 0));
+    if (self != nullptr) {
+        self->panel = nullptr;
+        self->mutex = new std::mutex();
+    }
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static void display_dealloc(display_object* self) {
+    auto type = Py_TYPE(self);
+    if (self->panel != nullptr) {
+        Py_BEGIN_ALLOW_THREADS;
+        delete self->panel;
+        Py_END_ALLOW_THREADS;
+    }
+    delete self->mutex;
+    type->tp_free(reinterpret_cast<PyObject*>(self));
+    Py_DECREF(type);
+}
+
+static int display_init(display_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"width", "height", "timing", nullptr};
+    uint8_t width;
+    uint8_t height;
+    PyObject* timing_object = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "bb|O", const_cast<char**>(keywords), &width, &height, &timing_object)) {
+        return -1;
+    }
+    auto override_timing = false;
+    auto timing = default_handshake_timing;
+    if (timing_object != Py_None) {
+        if (!PyArg_ParseTuple(timing_object, "HH", &timing.setup, &timing.hold)) {
+            return -1;
+        }
+        override_timing = true;
+    }
+    if (self->panel != nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "the display is already initialized");
+        return -1;
+    }
+    led_panel<>* panel = nullptr;
+    std::exception_ptr exception;
+    Py_BEGIN_ALLOW_THREADS;
+    try {
+        panel = new led_panel<>(width, height);
+        if (override_timing || load_timing(default_timing_path(), device_identifier(), timing)) {
+            panel->set_timing(timing);
+        }
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS;
+    if (exception) {
+        set_python_error(exception);
+        return -1;
+    }
+    self->panel = panel;
+    return 0;
+}
+
+static PyObject* display_send(display_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"brightness", "packed_frame", nullptr};
+    uint8_t brightness;
+    PyObject* packed_frame;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "bO", const_cast<char**>(keywords), &brightness, &packed_frame)) {
+        return nullptr;
+    }
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(packed_frame, &buffer, PyBUF_C_CONTIGUOUS) < 0) {
+        return nullptr;
+    }
+    const auto pixels = reinterpret_cast<const uint8_t*>(buffer.buf);
+    const auto size = buffer.len;
+    const auto sent = call_without_gil(self, [&](led_panel<>& panel) {
+        if (size != panel.frame_size()) {
+            throw std::logic_error(
+                "packed_frame must have " + std::to_string(panel.frame_size()) + " bytes (got "
+                + std::to_string(size) + ")");
+        }
+        panel.send(brightness, pixels);
+    });
+    PyBuffer_Release(&buffer);
+    if (!sent) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* display_skip_unchanged(display_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"enabled", "keep_alive", nullptr};
+    int enabled;
+    unsigned long long keep_alive = 1000;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "p|K", const_cast<char**>(keywords), &enabled, &keep_alive)) {
+        return nullptr;
+    }
+    if (!call_without_gil(self, [&](led_panel<>& panel) {
+            panel.skip_unchanged(enabled != 0, std::chrono::milliseconds(keep_alive));
+        })) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* display_resync(display_object* self, PyObject*) {
+    if (!call_without_gil(self, [](led_panel<>& panel) { panel.resync(); })) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* display_get_width(display_object* self, void*) {
+    uint8_t width = 0;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { width = panel.width(); })) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLong(width);
+}
+
+static PyObject* display_get_height(display_object* self, void*) {
+    uint8_t height = 0;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { height = panel.height(); })) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLong(height);
+}
+
+static PyObject* display_get_frame_size(display_object* self, void*) {
+    uint16_t frame_size = 0;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { frame_size = panel.frame_size(); })) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLong(frame_size);
+}
+
+static PyObject* display_get_sent(display_object* self, void*) {
+    uint64_t sent = 0;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { sent = panel.sent(); })) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLongLong(sent);
+}
+
+static PyObject* display_cache_waveforms(display_object* self, PyObject* args) {
+    unsigned long long capacity;
+    if (!PyArg_ParseTuple(args, "K", &capacity)) {
+        return nullptr;
+    }
+    if (!call_without_gil(self, [&](led_panel<>& panel) { panel.cache_waveforms(capacity); })) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* display_get_waveform_statistics(display_object* self, void*) {
+    waveform_cache_statistics statistics{};
+    if (!call_without_gil(self, [&](led_panel<>& panel) { statistics = panel.waveform_statistics(); })) {
+        return nullptr;
+    }
+    return Py_BuildValue(
+        "{s:K,s:K,s:K,s:n,s:n}",
+        "hits",
+        static_cast<unsigned long long>(statistics.hits),
+        "misses",
+        static_cast<unsigned long long>(statistics.misses),
+        "evictions",
+        static_cast<unsigned long long>(statistics.evictions),
+        "entries",
+        static_cast<Py_ssize_t>(statistics.entries),
+        "memory",
+        static_cast<Py_ssize_t>(statistics.memory));
+}
+
+static PyObject* display_get_buffer_depth(display_object* self, void*) {
+    uint8_t depth = 0;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { depth = panel.buffer_depth(); })) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLong(depth);
+}
+
+static int display_set_buffer_depth(display_object* self, PyObject* value, void*) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "buffer_depth cannot be deleted");
+        return -1;
+    }
+    const auto depth = PyLong_AsUnsignedLong(value);
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+    if (depth > 255) {
+        PyErr_SetString(PyExc_ValueError, "the buffer depth must be in the range [1, 7]");
+        return -1;
+    }
+    if (!call_without_gil(self, [&](led_panel<>& panel) { panel.set_buffer_depth(static_cast<uint8_t>(depth)); })) {
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject* display_get_presentation_time(display_object* self, void*) {
+    std::chrono::steady_clock::time_point presentation_time;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { presentation_time = panel.presentation_time(); })) {
+        return nullptr;
+    }
+    return PyFloat_FromDouble(std::chrono::duration<double>(presentation_time.time_since_epoch()).count());
+}
+
+static PyObject* display_get_skipped(display_object* self, void*) {
+    uint64_t skipped = 0;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { skipped = panel.skipped(); })) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLongLong(skipped);
+}
+
+static PyObject* display_get_timing(display_object* self, void*) {
+    auto timing = default_handshake_timing;
+    if (!call_without_gil(self, [&](led_panel<>& panel) { timing = panel.timing(); })) {
+        return nullptr;
+    }
+    return Py_BuildValue("(HH)", timing.setup, timing.hold);
+}
+
+static int display_set_timing(display_object* self, PyObject* value, void*) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "timing cannot be deleted");
+        return -1;
+    }
+    handshake_timing timing;
+    if (!PyArg_ParseTuple(value, "HH", &timing.setup, &timing.hold)) {
+        return -1;
+    }
+    if (!call_without_gil(self, [&](led_panel<>& panel) { panel.set_timing(timing); })) {
+        return -1;
+    }
+    return 0;
+}
+
+static PyMethodDef display_methods[] = {
+    {"send",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(display_send)),
+     METH_VARARGS | METH_KEYWORDS,
+     "send(brightness, packed_frame)\n"
+     "Transmits a frame and returns when the display has received it.\n"
+     "packed_frame can be any C-contiguous buffer (bytes, bytearray, numpy array...) with width * height * 64 bytes "
+     "(see led_panel.pack). It is read in place, without copies. The GIL is released during the transfer."},
+    {"skip_unchanged",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(display_skip_unchanged)),
+     METH_VARARGS | METH_KEYWORDS,
+     "skip_unchanged(enabled, keep_alive=1000)\n"
+     "Enables or disables unchanged-frame suppression. Repeated frames are still transmitted every keep_alive ms."},
+    {"cache_waveforms",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(display_cache_waveforms)),
+     METH_VARARGS,
+     "cache_waveforms(capacity)\n"
+     "Replays the last capacity frames from compiled GPIO waveforms, or disables the cache if capacity is 0."},
+    {"resync",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(display_resync)),
+     METH_NOARGS,
+     "resync()\n"
+     "Recovers from an interrupted transfer."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyGetSetDef display_getset[] = {
+    {"width", reinterpret_cast<getter>(display_get_width), nullptr, "number of horizontal panels", nullptr},
+    {"height", reinterpret_cast<getter>(display_get_height), nullptr, "number of vertical panels", nullptr},
+    {"frame_size",
+     reinterpret_cast<getter>(display_get_frame_size),
+     nullptr,
+     "number of packed pixel bytes per frame",
+     nullptr},
+    {"sent",
+     reinterpret_cast<getter>(display_get_sent),
+     nullptr,
+     "number of transmitted frames, including the 8 blank frames sent by the constructor",
+     nullptr},
+    {"skipped",
+     reinterpret_cast<getter>(display_get_skipped),
+     nullptr,
+     "number of frames skipped by unchanged-frame suppression",
+     nullptr},
+    {"waveform_statistics",
+     reinterpret_cast<getter>(display_get_waveform_statistics),
+     nullptr,
+     "waveform cache counters and memory usage in bytes (dict)",
+     nullptr},
+    {"buffer_depth",
+     reinterpret_cast<getter>(display_get_buffer_depth),
+     reinterpret_cast<setter>(display_set_buffer_depth),
+     "number of frames queued by the Arduino behind the displayed one, in the range [1, 7], lower values reduce the "
+     "display latency",
+     nullptr},
+    {"presentation_time",
+     reinterpret_cast<getter>(display_get_presentation_time),
+     nullptr,
+     "estimated time at which the last frame is displayed, in seconds on the time.monotonic clock",
+     nullptr},
+    {"timing",
+     reinterpret_cast<getter>(display_get_timing),
+     reinterpret_cast<setter>(display_set_timing),
+     "handshake delays (setup, hold), as a number of nops",
+     nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+static PyType_Slot display_slots[] = {
+    {Py_tp_doc,
+     const_cast<char*>(
+         "display(width, height, timing=None)\n"
+         "Controls an array of LED panels from the current process.\n"
+         "width and height are a number of panels, not a number of pixels. timing overrides the calibrated handshake "
+         "delays (setup, hold).")},
+    {Py_tp_new, reinterpret_cast<void*>(display_new)},
+    {Py_tp_init, reinterpret_cast<void*>(display_init)},
+    {Py_tp_dealloc, reinterpret_cast<void*>(display_dealloc)},
+    {Py_tp_methods, display_methods},
+    {Py_tp_getset, display_getset},
+    {0, nullptr},
+};
+
+static PyType_Spec display_spec = {
+    "led_panel_native.display",
+    sizeof(display_object),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    display_slots,
+};
+
+/// raster_object is the Python representation of a packed_raster.
+/// Drawing operations are short and hold the GIL. Fonts are created on demand, one per scale.
+struct raster_object {
+    PyObject_HEAD
+    packed_raster* raster;
+    std::array<bitmap_font*, 8> fonts;
+};
+
+/// string_to_raster_op parses a raster operation name, or sets a Python exception and returns false.
+static bool string_to_raster_op(const char* name, raster_op& op) {
+    const std::string value(name);
+    if (value == "copy") {
+        op = raster_op::copy;
+    } else if (value == "or") {
+        op = raster_op::bitwise_or;
+    } else if (value == "xor") {
+        op = raster_op::bitwise_xor;
+    } else if (value == "and") {
+        op = raster_op::bitwise_and;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "op must be 'copy', 'or', 'xor' or 'and'");
+        return false;
+    }
+    return true;
+}
+
+/// initialized_raster returns true if the raster is initialized, and sets a Python exception otherwise.
+static bool initialized_raster(raster_object* self) {
+    if (self->raster == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "the raster is not initialized");
+        return false;
+    }
+    return true;
+}
+
+static PyObject* raster_new(PyTypeObject* type, PyObject*, PyObject*) {
+    auto self = reinterpret_cast<raster_object*>(type->tp_alloc(type, 0));
+    if (self != nullptr) {
+        self->raster = nullptr;
+        self->fonts.fill(nullptr);
+    }
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static void raster_dealloc(raster_object* self) {
+    auto type = Py_TYPE(self);
+    delete self->raster;
+    for (auto font : self->fonts) {
+        delete font;
+    }
+    type->tp_free(reinterpret_cast<PyObject*>(self));
+    Py_DECREF(type);
+}
+
+static int raster_init(raster_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"width", "height", nullptr};
+    uint8_t width;
+    uint8_t height;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "bb", const_cast<char**>(keywords), &width, &height)) {
+        return -1;
+    }
+    if (self->raster != nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "the raster is already initialized");
+        return -1;
+    }
+    try {
+        self->raster = new packed_raster(width, height);
+    } catch (...) {
+        set_python_error(std::current_exception());
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject* raster_clear(raster_object* self, PyObject*) {
+    if (!initialized_raster(self)) {
+        return nullptr;
+    }
+    self->raster->clear();
+    Py_RETURN_NONE;
+}
+
+static PyObject* raster_set_clip(raster_object* self, PyObject* args) {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    if (!initialized_raster(self) || !PyArg_ParseTuple(args, "iiii", &x, &y, &width, &height)) {
+        return nullptr;
+    }
+    self->raster->set_clip(x, y, width, height);
+    Py_RETURN_NONE;
+}
+
+static PyObject* raster_reset_clip(raster_object* self, PyObject*) {
+    if (!initialized_raster(self)) {
+        return nullptr;
+    }
+    self->raster->reset_clip();
+    Py_RETURN_NONE;
+}
+
+static PyObject* raster_fill_rect(raster_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"x", "y", "width", "height", "on", "op", nullptr};
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int on = 1;
+    const char* op_name = "copy";
+    raster_op op;
+    if (!initialized_raster(self)
+        || !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "iiii|ps", const_cast<char**>(keywords), &x, &y, &width, &height, &on, &op_name)
+        || !string_to_raster_op(op_name, op)) {
+        return nullptr;
+    }
+    self->raster->fill_rect(x, y, width, height, on != 0, op);
+    Py_RETURN_NONE;
+}
+
+static PyObject* raster_blit(raster_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"bitmap", "width", "x", "y", "op", nullptr};
+    PyObject* bitmap_object;
+    uint16_t width;
+    int32_t x;
+    int32_t y;
+    const char* op_name = "or";
+    raster_op op;
+    if (!initialized_raster(self)
+        || !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "OHii|s", const_cast<char**>(keywords), &bitmap_object, &width, &x, &y, &op_name)
+        || !string_to_raster_op(op_name, op)) {
+        return nullptr;
+    }
+    if (width == 0) {
+        PyErr_SetString(PyExc_ValueError, "width must be larger than 0");
+        return nullptr;
+    }
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(bitmap_object, &buffer, PyBUF_C_CONTIGUOUS) < 0) {
+        return nullptr;
+    }
+    const auto stride = static_cast<uint16_t>((width + 7) / 8);
+    if (buffer.len % stride != 0 || buffer.len / stride > 0xffff) {
+        PyBuffer_Release(&buffer);
+        PyErr_SetString(PyExc_ValueError, "bitmap must have (width + 7) // 8 bytes per row, and less than 65536 rows");
+        return nullptr;
+    }
+    self->raster->blit(
+        {width, static_cast<uint16_t>(buffer.len / stride), stride, reinterpret_cast<const uint8_t*>(buffer.buf)},
+        x,
+        y,
+        op);
+    PyBuffer_Release(&buffer);
+    Py_RETURN_NONE;
+}
+
+static PyObject* raster_draw_text(raster_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"text", "x", "y", "op", "scale", nullptr};
+    const char* text;
+    Py_ssize_t size;
+    int32_t x;
+    int32_t y;
+    const char* op_name = "or";
+    uint8_t scale = 1;
+    raster_op op;
+    if (!initialized_raster(self)
+        || !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "s#ii|sb", const_cast<char**>(keywords), &text, &size, &x, &y, &op_name, &scale)
+        || !string_to_raster_op(op_name, op)) {
+        return nullptr;
+    }
+    if (scale == 0 || scale > self->fonts.size()) {
+        PyErr_SetString(PyExc_ValueError, "scale must be in the range [1, 8]");
+        return nullptr;
+    }
+    auto& font = self->fonts[scale - 1];
+    if (font == nullptr) {
+        font = new bitmap_font(font_5x7_columns.data(), 5, 7, 32, 95, 1, scale);
+    }
+    return PyLong_FromLong(self->raster->draw_text(*font, std::string(text, size), x, y, op));
+}
+
+static PyObject* raster_scroll(raster_object* self, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"dx", "dy", "wrap", nullptr};
+    int32_t dx;
+    int32_t dy;
+    int wrap = 0;
+    if (!initialized_raster(self)
+        || !PyArg_ParseTupleAndKeywords(args, kwargs, "ii|p", const_cast<char**>(keywords), &dx, &dy, &wrap)) {
+        return nullptr;
+    }
+    self->raster->scroll(dx, dy, wrap != 0);
+    Py_RETURN_NONE;
+}
+
+static PyObject* raster_pixel(raster_object* self, PyObject* args) {
+    int32_t x;
+    int32_t y;
+    if (!initialized_raster(self) || !PyArg_ParseTuple(args, "ii", &x, &y)) {
+        return nullptr;
+    }
+    if (x < 0 || y < 0 || x >= self->raster->width() || y >= self->raster->height()) {
+        PyErr_SetString(PyExc_IndexError, "the pixel is outside the frame");
+        return nullptr;
+    }
+    return PyBool_FromLong(self->raster->pixel(x, y));
+}
+
+static PyObject* raster_get_width(raster_object* self, void*) {
+    if (!initialized_raster(self)) {
+        return nullptr;
+    }
+    return PyLong_FromLong(self->raster->width());
+}
+
+static PyObject* raster_get_height(raster_object* self, void*) {
+    if (!initialized_raster(self)) {
+        return nullptr;
+    }
+    return PyLong_FromLong(self->raster->height());
+}
+
+/// raster_get_buffer exposes the packed pixels (without the brightness byte), so that the raster can be passed to
+/// display.send without copies.
+static int raster_get_buffer(raster_object* self, Py_buffer* view, int flags) {
+    if (!initialized_raster(self)) {
+        return -1;
+    }
+    return PyBuffer_FillInfo(
+        view,
+        reinterpret_cast<PyObject*>(self),
+        self->raster->pixels(),
+        static_cast<Py_ssize_t>(self->raster->frame().size() - 1),
+        0,
+        flags);
+}
+
+static PyMethodDef raster_methods[] = {
+    {"clear",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_clear)),
+     METH_NOARGS,
+     "clear()\n"
+     "Turns off the pixels of the clip rectangle."},
+    {"set_clip",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_set_clip)),
+     METH_VARARGS,
+     "set_clip(x, y, width, height)\n"
+     "Restricts the following operations to a rectangle."},
+    {"reset_clip",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_reset_clip)),
+     METH_NOARGS,
+     "reset_clip()\n"
+     "Restores the default clip rectangle (the whole frame)."},
+    {"fill_rect",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_fill_rect)),
+     METH_VARARGS | METH_KEYWORDS,
+     "fill_rect(x, y, width, height, on=True, op='copy')\n"
+     "Combines a rectangle of constant pixels with the frame. op is 'copy', 'or', 'xor' or 'and'."},
+    {"blit",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_blit)),
+     METH_VARARGS | METH_KEYWORDS,
+     "blit(bitmap, width, x, y, op='or')\n"
+     "Combines a 1-bpp bitmap with the frame, with its top-left pixel at (x, y).\n"
+     "bitmap is a buffer with (width + 7) // 8 bytes per row, most significant bit first "
+     "(numpy.packbits(image, axis=1))."},
+    {"draw_text",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_draw_text)),
+     METH_VARARGS | METH_KEYWORDS,
+     "draw_text(text, x, y, op='or', scale=1)\n"
+     "Draws ASCII text with the 5 x 7 font (6 * scale pixels per character) and returns the x coordinate after the "
+     "last character."},
+    {"scroll",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_scroll)),
+     METH_VARARGS | METH_KEYWORDS,
+     "scroll(dx, dy, wrap=False)\n"
+     "Moves the pixels of the clip rectangle. Vacated pixels are turned off, or filled with the pixels that leave the "
+     "rectangle if wrap is True."},
+    {"pixel",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(raster_pixel)),
+     METH_VARARGS,
+     "pixel(x, y)\n"
+     "Returns True if the pixel is on."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyGetSetDef raster_getset[] = {
+    {"width", reinterpret_cast<getter>(raster_get_width), nullptr, "frame width in pixels", nullptr},
+    {"height", reinterpret_cast<getter>(raster_get_height), nullptr, "frame height in pixels", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+static PyType_Slot raster_slots[] = {
+    {Py_tp_doc,
+     const_cast<char*>(
+         "raster(width, height)\n"
+         "Draws on a packed frame without numpy (see packed_raster.hpp).\n"
+         "width and height are a number of panels, not a number of pixels. The raster supports the buffer protocol "
+         "and can be passed to display.send as packed_frame.")},
+    {Py_tp_new, reinterpret_cast<void*>(raster_new)},
+    {Py_tp_init, reinterpret_cast<void*>(raster_init)},
+    {Py_tp_dealloc, reinterpret_cast<void*>(raster_dealloc)},
+    {Py_tp_methods, raster_methods},
+    {Py_tp_getset, raster_getset},
+    {Py_bf_getbuffer, reinterpret_cast<void*>(raster_get_buffer)},
+    {0, nullptr},
+};
+
+static PyType_Spec raster_spec = {
+    "led_panel_native.raster",
+    sizeof(raster_object),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    raster_slots,
+};
+
+static PyObject* module_pack(PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"frame", "dithering", "threshold", nullptr};
+    PyObject* frame;
+    const char* method_name = "ordered";
+    uint8_t threshold = 128;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|sb", const_cast<char**>(keywords), &frame, &method_name, &threshold)) {
+        return nullptr;
+    }
+    dithering method;
+    try {
+        method = string_to_dithering(method_name);
+    } catch (const std::runtime_error& error) {
+        PyErr_SetString(PyExc_ValueError, error.what());
+        return nullptr;
+    }
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(frame, &buffer, PyBUF_C_CONTIGUOUS) < 0) {
+        return nullptr;
+    }
+    if (buffer.ndim != 2 || buffer.itemsize != 1) {
+        PyBuffer_Release(&buffer);
+        PyErr_SetString(PyExc_ValueError, "frame must be a two-dimensional array of bytes (height, width)");
+        return nullptr;
+    }
+    const auto height = buffer.shape[0];
+    const auto width = buffer.shape[1];
+    if (width > 0xffff || height > 0xffff) {
+        PyBuffer_Release(&buffer);
+        PyErr_SetString(PyExc_ValueError, "frame must be smaller than 65536 x 65536 pixels");
+        return nullptr;
+    }
+    auto packed = PyBytes_FromStringAndSize(nullptr, width * height / 8);
+    if (packed == nullptr) {
+        PyBuffer_Release(&buffer);
+        return nullptr;
+    }
+    std::exception_ptr exception;
+    Py_BEGIN_ALLOW_THREADS;
+    try {
+        grayscale_packer packer(static_cast<uint16_t>(width), static_cast<uint16_t>(height), method, threshold);
+        packer.pack(
+            reinterpret_cast<const uint8_t*>(buffer.buf), reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(packed)));
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    Py_END_ALLOW_THREADS;
+    PyBuffer_Release(&buffer);
+    if (exception) {
+        Py_DECREF(packed);
+        set_python_error(exception);
+        return nullptr;
+    }
+    return packed;
+}
+
+static PyMethodDef module_methods[] = {
+    {"pack",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(module_pack)),
+     METH_VARARGS | METH_KEYWORDS,
+     "pack(frame, dithering='ordered', threshold=128)\n"
+     "Converts a grayscale frame (two-dimensional uint8 array, height x width) to packed bytes for send.\n"
+     "dithering is 'threshold' (pixels larger than or equal to threshold are on), 'ordered' (8 x 8 Bayer matrix) or "
+     "'error-diffusion' (Floyd-Steinberg). The GIL is released during the conversion."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyModuleDef led_panel_native_definition = {
+    PyModuleDef_HEAD_INIT,
+    "led_panel_native",
+    "In-process led_panel driver (see led_panel.hpp)",
+    -1,
+    module_methods,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+};
+
+PyMODINIT_FUNC PyInit_led_panel_native() {
+    auto module = PyModule_Create(&led_panel_native_definition);
+    if (module == nullptr) {
+        return nullptr;
+    }
+    auto display_type = PyType_FromSpec(&display_spec);
+    if (display_type == nullptr || PyModule_AddObject(module, "display", display_type) < 0) {
+        Py_XDECREF(display_type);
+        Py_DECREF(module);
+        return nullptr;
+    }
+    auto raster_type = PyType_FromSpec(&raster_spec);
+    if (raster_type == nullptr || PyModule_AddObject(module, "raster", raster_type) < 0) {
+        Py_XDECREF(raster_type);
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
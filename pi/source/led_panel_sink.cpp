@@ -1,40 +1,359 @@
+#include "async_led_panel.hpp"
+#include "calibration.hpp"
+#include "command_line.hpp"
+#include "grayscale_packer.hpp"
 #include "led_panel.hpp"
+#include "realtime.hpp"
+#include "shared_frame_ring.hpp"
+#include "temporal_grayscale.hpp"
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
-uint8_t string_to_uint8(const std::string& name, const std::string& input) {
-    const auto candidate = stoul(input);
-    if (candidate > 255) {
-        throw std::out_of_range(name + " must be smaller than 256");
-    }
-    return static_cast<uint8_t>(candidate);
+/// recovery_attempts is the number of resyncs attempted after an acknowledge timeout before the sink exits. With the
+/// default timeout, the sink waits for about 4 s (enough for an Arduino to reboot) before giving up.
+constexpr uint32_t recovery_attempts = 20;
+
+/// read_frame reads a frame from the standard input, and returns false at the end of the stream.
+bool read_frame(std::vector<uint8_t>& frame) {
+    std::cin.read(reinterpret_cast<char*>(frame.data()), frame.size());
+    return std::cin.good();
 }
 
+/// metrics_dump periodically writes the display's metrics (see instrumentation.hpp) to the standard error, from a
+/// dedicated thread. A last dump is written when the object is destroyed.
+template <typename Panel>
+class metrics_dump {
+    public:
+    metrics_dump(Panel& panel, std::chrono::milliseconds period, bool json) :
+        _panel(panel),
+        _period(period),
+        _json(json),
+        _running(true) {
+        _loop = std::thread([this]() {
+            auto previous = _panel.metrics().snapshot();
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (;;) {
+                const auto stop = _condition.wait_for(lock, _period, [this]() { return !_running; });
+                const auto current = _panel.metrics().snapshot();
+                std::cerr << (_json ? instrumentation_to_json(current, previous)
+                                    : "metrics: " + instrumentation_to_text(current, previous))
+                          << std::endl;
+                previous = current;
+                if (stop) {
+                    break;
+                }
+            }
+        });
+    }
+    metrics_dump(const metrics_dump&) = delete;
+    metrics_dump(metrics_dump&& other) = delete;
+    metrics_dump& operator=(const metrics_dump&) = delete;
+    metrics_dump& operator=(metrics_dump&& other) = delete;
+    virtual ~metrics_dump() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _condition.notify_one();
+        _loop.join();
+    }
+
+    protected:
+    Panel& _panel;
+    const std::chrono::milliseconds _period;
+    const bool _json;
+    bool _running;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _loop;
+};
+
 int main(int argc, char* argv[]) {
     uint8_t width = 1;
     uint8_t height = 1;
+    auto skip_unchanged = false;
+    std::chrono::milliseconds keep_alive(0);
+    std::size_t capacity = 0;
+    auto policy = backpressure::block;
+    int32_t core = -1;
+    auto calibrate_timing = false;
+    auto override_timing = false;
+    auto timing = default_handshake_timing;
+    std::string shared_memory;
+    auto grayscale = false;
+    auto method = dithering::ordered;
+    uint8_t planes = 0;
+    std::chrono::milliseconds metrics_period(0);
+    auto metrics_json = false;
+    std::size_t waveforms = 0;
+    auto deltas = false;
+    auto buffer_depth = led_panel<>::max_buffer_depth;
+    auto realtime = false;
+    int32_t priority = 0;
+    std::chrono::milliseconds timeout(0);
     try {
-        if (argc != 3) {
+        if (argc < 3) {
             throw std::runtime_error("bad number of arguments");
         }
         width = string_to_uint8("width", argv[1]);
         height = string_to_uint8("height", argv[2]);
+        for (int index = 3; index < argc; ++index) {
+            const std::string option(argv[index]);
+            if (option == "--skip-unchanged") {
+                skip_unchanged = true;
+                keep_alive = std::chrono::milliseconds(stoul(option_value(argc, argv, index)));
+            } else if (option == "--queue") {
+                capacity = stoul(option_value(argc, argv, index));
+            } else if (option == "--backpressure") {
+                const auto value = option_value(argc, argv, index);
+                if (value == "block") {
+                    policy = backpressure::block;
+                } else if (value == "drop-oldest") {
+                    policy = backpressure::drop_oldest;
+                } else if (value == "drop-newest") {
+                    policy = backpressure::drop_newest;
+                } else {
+                    throw std::runtime_error("unknown backpressure policy '" + value + "'");
+                }
+            } else if (option == "--core") {
+                core = static_cast<int32_t>(stoul(option_value(argc, argv, index)));
+            } else if (option == "--shm") {
+                shared_memory = option_value(argc, argv, index);
+            } else if (option == "--grayscale") {
+                grayscale = true;
+                method = string_to_dithering(option_value(argc, argv, index));
+            } else if (option == "--temporal") {
+                planes = string_to_uint8("planes", option_value(argc, argv, index));
+                if (planes == 0 || planes > maximum_planes) {
+                    throw std::out_of_range(
+                        "the number of planes must be in the range [1, " + std::to_string(maximum_planes) + "]");
+                }
+            } else if (option == "--metrics") {
+                if (!instrumentation_enabled) {
+                    throw std::runtime_error(
+                        "--metrics requires an instrumented build (build/led_panel_sink_instrumented)");
+                }
+                metrics_period = std::chrono::milliseconds(stoul(option_value(argc, argv, index)));
+                if (metrics_period.count() == 0) {
+                    throw std::out_of_range("the metrics period must be larger than 0");
+                }
+            } else if (option == "--metrics-json") {
+                metrics_json = true;
+            } else if (option == "--waveform-cache") {
+                waveforms = stoul(option_value(argc, argv, index));
+            } else if (option == "--delta") {
+                deltas = true;
+            } else if (option == "--buffer-depth") {
+                buffer_depth = string_to_uint8("buffer depth", option_value(argc, argv, index));
+                if (buffer_depth == 0 || buffer_depth > led_panel<>::max_buffer_depth) {
+                    throw std::out_of_range("the buffer depth must be in the range [1, 7]");
+                }
+            } else if (option == "--realtime") {
+                realtime = true;
+                priority = static_cast<int32_t>(stoul(option_value(argc, argv, index)));
+                if (priority > 99) {
+                    throw std::out_of_range("the real-time priority must be in the range [0, 99]");
+                }
+            } else if (option == "--timeout") {
+                timeout = std::chrono::milliseconds(stoul(option_value(argc, argv, index)));
+                if (timeout.count() == 0) {
+                    throw std::out_of_range("the timeout must be larger than 0");
+                }
+            } else if (option == "--calibrate") {
+                calibrate_timing = true;
+            } else if (option == "--timing") {
+                override_timing = true;
+                timing.setup = static_cast<uint16_t>(stoul(option_value(argc, argv, index)));
+                timing.hold = static_cast<uint16_t>(stoul(option_value(argc, argv, index)));
+            } else {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+        if (planes > 0 && (grayscale || capacity > 0)) {
+            throw std::runtime_error("--temporal cannot be combined with --grayscale or --queue");
+        }
     } catch (const std::exception& error) {
-        std::cerr << error.what()
-                  << "\nsyntax: led_panel_sink width height\n    width and height are a number of panels, not a number "
-                     "of pixels"
+        std::cerr << error.what() << "\n"
+                  << "syntax: led_panel_sink width height [options]\n"
+                  << "    width and height are a number of panels, not a number of pixels\n"
+                  << "options:\n"
+                  << "    --skip-unchanged keep_alive    do not transmit repeated frames, except every keep_alive ms\n"
+                  << "    --queue capacity               transmit from a dedicated thread, with up to capacity queued\n"
+                  << "                                   frames\n"
+                  << "    --backpressure policy          block (default), drop-oldest or drop-newest, used when the\n"
+                  << "                                   queue is full\n"
+                  << "    --core index                   pin the transmit thread to a core\n"
+                  << "    --realtime priority            lock the memory, run the transmit thread with the SCHED_FIFO\n"
+                  << "                                   policy and the given priority (0 keeps the default\n"
+                  << "                                   scheduler), and enable --timeout 50 (see realtime.hpp)\n"
+                  << "    --timeout ms                   resync and send the frame again if a byte is not\n"
+                  << "                                   acknowledged within ms, exit after 20 failed resyncs (the\n"
+                  << "                                   default waits forever)\n"
+                  << "    --calibrate                    calibrate the handshake delays and save them\n"
+                  << "    --timing setup hold            use the given handshake delays (number of nops) instead of\n"
+                  << "                                   the saved calibration\n"
+                  << "    --shm name                     read frames from the shared memory ring /dev/shm/name\n"
+                  << "                                   (see shared_frame_ring.hpp) instead of the standard input\n"
+                  << "    --grayscale method             read grayscale frames (brightness, then one byte per pixel)\n"
+                  << "                                   and pack them with the given dithering method: threshold,\n"
+                  << "                                   ordered or error-diffusion\n"
+                  << "    --temporal planes              read grayscale frames and display 2^planes levels with\n"
+                  << "                                   bit-plane modulation (planes in [1, 4], see\n"
+                  << "                                   temporal_grayscale.hpp)\n"
+                  << "    --metrics period               write the transfer counters and histograms to the standard\n"
+                  << "                                   error every period ms (requires an instrumented build,\n"
+                  << "                                   build/led_panel_sink_instrumented)\n"
+                  << "    --metrics-json                 write the metrics as JSON lines instead of text\n"
+                  << "    --waveform-cache frames        replay the last frames from compiled GPIO waveforms (see\n"
+                  << "                                   waveform_cache.hpp)\n"
+                  << "    --delta                        transmit only the rows that changed since the previous frame\n"
+                  << "                                   (requires the delta firmware)\n"
+                  << "    --buffer-depth frames          number of frames queued by the Arduino behind the displayed\n"
+                  << "                                   one, from 1 to 7 (defaults to 7), lower values reduce the\n"
+                  << "                                   display latency"
                   << std::endl;
         return 1;
     }
-    led_panel display(width, height);
-    std::vector<uint8_t> frame(64 * width * height + 1);
-    for (;;) {
-        std::cin.read(reinterpret_cast<char*>(frame.data()), frame.size());
-        if (!std::cin.good()) {
-            break;
+    if (realtime) {
+        try {
+            lock_memory();
+        } catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+        if (timeout.count() == 0) {
+            timeout = std::chrono::duration_cast<std::chrono::milliseconds>(recommended_acknowledge_timeout);
         }
-        display.send(frame);
+    }
+    std::unique_ptr<led_panel<>> display_pointer;
+    try {
+        display_pointer.reset(
+            new led_panel<>(width, height, gpiomem(), timeout, timeout.count() > 0 ? recovery_attempts : 0));
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    auto& display = *display_pointer;
+    if (calibrate_timing) {
+        try {
+            const auto result = calibrate(display);
+            save_timing(default_timing_path(), device_identifier(), result.timing);
+            std::cerr << "calibrated timing: setup " << result.timing.setup << ", hold " << result.timing.hold
+                      << " (byte duration " << result.byte_duration.count() << " ns, acknowledge latency "
+                      << result.acknowledge_latency.count() << " ns)" << std::endl;
+        } catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    } else if (override_timing || load_timing(default_timing_path(), device_identifier(), timing)) {
+        display.set_timing(timing);
+    }
+    display.skip_unchanged(skip_unchanged, keep_alive);
+    display.cache_waveforms(waveforms);
+    display.send_deltas(deltas);
+    display.set_buffer_depth(buffer_depth);
+    std::unique_ptr<grayscale_packer> packer;
+    if (grayscale) {
+        packer.reset(new grayscale_packer(32 * width, 16 * height, method));
+    }
+    std::unique_ptr<temporal_grayscale<led_panel<>>> temporal;
+    if (planes > 0) {
+        temporal.reset(new temporal_grayscale<led_panel<>>(display, planes));
+    }
+    std::vector<uint8_t> input(grayscale || temporal ? 512 * width * height + 1 : display.frame_size() + 1);
+    std::vector<uint8_t> frame(display.frame_size() + 1);
+
+    // to_frame returns the packed frame that corresponds to an input frame
+    const auto to_frame = [&](const uint8_t* input_frame) -> const uint8_t* {
+        if (!packer) {
+            return input_frame;
+        }
+        frame[0] = input_frame[0];
+        packer->pack(input_frame + 1, frame.data() + 1);
+        return frame.data();
+    };
+    std::unique_ptr<shared_frame_ring> ring;
+
+    // next_input waits for an input frame, and returns nullptr at the end of the stream
+    const auto next_input = [&]() -> const uint8_t* {
+        std::chrono::steady_clock::time_point begin;
+        if constexpr (instrumentation_enabled) {
+            begin = std::chrono::steady_clock::now();
+        }
+        const uint8_t* input_frame = nullptr;
+        if (ring) {
+            input_frame = ring->acquire_read();
+        } else if (read_frame(input)) {
+            input_frame = input.data();
+        }
+        if constexpr (instrumentation_enabled) {
+            display.metrics().record_input_wait(std::chrono::steady_clock::now() - begin);
+        }
+        return input_frame;
+    };
+
+    // release_input frees the input frame returned by next_input
+    const auto release_input = [&]() {
+        if (ring) {
+            ring->release_read();
+        }
+    };
+    std::unique_ptr<metrics_dump<led_panel<>>> dump;
+    if (metrics_period.count() > 0) {
+        dump.reset(new metrics_dump<led_panel<>>(display, metrics_period, metrics_json));
+    }
+    try {
+        if (!shared_memory.empty()) {
+            ring.reset(new shared_frame_ring(shared_memory, input.size()));
+        }
+        if (temporal) {
+            set_thread_scheduling(pthread_self(), priority, core);
+            for (auto input_frame = next_input(); input_frame != nullptr; input_frame = next_input()) {
+                temporal->send(input_frame[0], input_frame + 1);
+                release_input();
+            }
+            std::cerr << "sent " << temporal->sent() << " groups of " << static_cast<uint32_t>(planes)
+                      << " planes, skipped " << temporal->skipped() << " unchanged groups, plane transfer "
+                      << temporal->plane_transfer_duration().count() / 1000 << " us ("
+                      << temporal->budget_usage() * 100 << " % of the display period)" << std::endl;
+        } else if (capacity == 0) {
+            set_thread_scheduling(pthread_self(), priority, core);
+            for (auto input_frame = next_input(); input_frame != nullptr; input_frame = next_input()) {
+                display.send(to_frame(input_frame));
+                release_input();
+            }
+        } else {
+            async_led_panel<led_panel<>> sender(display, capacity, policy, core, priority);
+            for (auto input_frame = next_input(); input_frame != nullptr; input_frame = next_input()) {
+                sender.submit(to_frame(input_frame));
+                release_input();
+            }
+            sender.flush();
+            if (sender.dropped() > 0) {
+                std::cerr << "dropped " << sender.dropped() << " frames" << std::endl;
+            }
+        }
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    if (display.recoveries() > 0) {
+        std::cerr << "recovered from " << display.recoveries() << " acknowledge timeouts" << std::endl;
+    }
+    if (skip_unchanged) {
+        std::cerr << "sent " << display.sent() << " frames, skipped " << display.skipped() << " unchanged frames"
+                  << std::endl;
+    }
+    if (waveforms > 0) {
+        const auto statistics = display.waveform_statistics();
+        std::cerr << "waveform cache: " << statistics.hits << " hits, " << statistics.misses << " misses, "
+                  << statistics.evictions << " evictions, " << statistics.entries << " waveforms using "
+                  << statistics.memory << " bytes" << std::endl;
     }
     return 0;
 }
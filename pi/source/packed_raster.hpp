@@ -0,0 +1,586 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// raster_op selects how drawn pixels are combined with the frame.
+enum class raster_op {
+    /// copy replaces the frame pixels.
+    copy,
+
+    /// bitwise_or turns on the frame pixels where the source is on.
+    bitwise_or,
+
+    /// bitwise_xor inverts the frame pixels where the source is on.
+    bitwise_xor,
+
+    /// bitwise_and turns off the frame pixels where the source is off.
+    bitwise_and,
+};
+
+/// packed_bitmap points to a 1-bpp image, such as a sprite or a font atlas.
+/// Rows are stride bytes apart, and each row stores 8 pixels per byte with the leftmost pixel in the most significant
+/// bit (the layout of numpy.packbits(image, axis=1)).
+struct packed_bitmap {
+    uint16_t width;
+    uint16_t height;
+    uint16_t stride;
+    const uint8_t* data;
+};
+
+/// font_5x7_columns stores the printable ASCII characters (32 to 126) of a 5 x 7 font.
+/// Each glyph has 5 column bytes, with the top pixel in the least significant bit (the layout of most LCD fonts).
+inline constexpr std::array<uint8_t, 95 * 5> font_5x7_columns = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5f, 0x00, 0x00, 0x00, 0x07, 0x00, 0x07, 0x00, 0x14, 0x7f, 0x14, 0x7f,
+    0x14, 0x24, 0x2a, 0x7f, 0x2a, 0x12, 0x23, 0x13, 0x08, 0x64, 0x62, 0x36, 0x49, 0x55, 0x22, 0x50, 0x00, 0x05, 0x03,
+    0x00, 0x00, 0x00, 0x1c, 0x22, 0x41, 0x00, 0x00, 0x41, 0x22, 0x1c, 0x00, 0x08, 0x2a, 0x1c, 0x2a, 0x08, 0x08, 0x08,
+    0x3e, 0x08, 0x08, 0x00, 0x50, 0x30, 0x00, 0x00, 0x08, 0x08, 0x08, 0x08, 0x08, 0x00, 0x60, 0x60, 0x00, 0x00, 0x20,
+    0x10, 0x08, 0x04, 0x02, 0x3e, 0x51, 0x49, 0x45, 0x3e, 0x00, 0x42, 0x7f, 0x40, 0x00, 0x42, 0x61, 0x51, 0x49, 0x46,
+    0x21, 0x41, 0x45, 0x4b, 0x31, 0x18, 0x14, 0x12, 0x7f, 0x10, 0x27, 0x45, 0x45, 0x45, 0x39, 0x3c, 0x4a, 0x49, 0x49,
+    0x30, 0x01, 0x71, 0x09, 0x05, 0x03, 0x36, 0x49, 0x49, 0x49, 0x36, 0x06, 0x49, 0x49, 0x29, 0x1e, 0x00, 0x36, 0x36,
+    0x00, 0x00, 0x00, 0x56, 0x36, 0x00, 0x00, 0x08, 0x14, 0x22, 0x41, 0x00, 0x14, 0x14, 0x14, 0x14, 0x14, 0x00, 0x41,
+    0x22, 0x14, 0x08, 0x02, 0x01, 0x51, 0x09, 0x06, 0x32, 0x49, 0x79, 0x41, 0x3e, 0x7e, 0x11, 0x11, 0x11, 0x7e, 0x7f,
+    0x49, 0x49, 0x49, 0x36, 0x3e, 0x41, 0x41, 0x41, 0x22, 0x7f, 0x41, 0x41, 0x22, 0x1c, 0x7f, 0x49, 0x49, 0x49, 0x41,
+    0x7f, 0x09, 0x09, 0x01, 0x01, 0x3e, 0x41, 0x41, 0x51, 0x32, 0x7f, 0x08, 0x08, 0x08, 0x7f, 0x00, 0x41, 0x7f, 0x41,
+    0x00, 0x20, 0x40, 0x41, 0x3f, 0x01, 0x7f, 0x08, 0x14, 0x22, 0x41, 0x7f, 0x40, 0x40, 0x40, 0x40, 0x7f, 0x02, 0x04,
+    0x02, 0x7f, 0x7f, 0x04, 0x08, 0x10, 0x7f, 0x3e, 0x41, 0x41, 0x41, 0x3e, 0x7f, 0x09, 0x09, 0x09, 0x06, 0x3e, 0x41,
+    0x51, 0x21, 0x5e, 0x7f, 0x09, 0x19, 0x29, 0x46, 0x46, 0x49, 0x49, 0x49, 0x31, 0x01, 0x01, 0x7f, 0x01, 0x01, 0x3f,
+    0x40, 0x40, 0x40, 0x3f, 0x1f, 0x20, 0x40, 0x20, 0x1f, 0x7f, 0x20, 0x18, 0x20, 0x7f, 0x63, 0x14, 0x08, 0x14, 0x63,
+    0x03, 0x04, 0x78, 0x04, 0x03, 0x61, 0x51, 0x49, 0x45, 0x43, 0x00, 0x7f, 0x41, 0x41, 0x00, 0x02, 0x04, 0x08, 0x10,
+    0x20, 0x00, 0x41, 0x41, 0x7f, 0x00, 0x04, 0x02, 0x01, 0x02, 0x04, 0x40, 0x40, 0x40, 0x40, 0x40, 0x00, 0x01, 0x02,
+    0x04, 0x00, 0x20, 0x54, 0x54, 0x54, 0x78, 0x7f, 0x48, 0x44, 0x44, 0x38, 0x38, 0x44, 0x44, 0x44, 0x20, 0x38, 0x44,
+    0x44, 0x48, 0x7f, 0x38, 0x54, 0x54, 0x54, 0x18, 0x08, 0x7e, 0x09, 0x01, 0x02, 0x0c, 0x52, 0x52, 0x52, 0x3e, 0x7f,
+    0x08, 0x04, 0x04, 0x78, 0x00, 0x44, 0x7d, 0x40, 0x00, 0x20, 0x40, 0x44, 0x3d, 0x00, 0x7f, 0x10, 0x28, 0x44, 0x00,
+    0x00, 0x41, 0x7f, 0x40, 0x00, 0x7c, 0x04, 0x18, 0x04, 0x78, 0x7c, 0x08, 0x04, 0x04, 0x78, 0x38, 0x44, 0x44, 0x44,
+    0x38, 0x7c, 0x14, 0x14, 0x14, 0x08, 0x08, 0x14, 0x14, 0x18, 0x7c, 0x7c, 0x08, 0x04, 0x04, 0x08, 0x48, 0x54, 0x54,
+    0x54, 0x20, 0x04, 0x3f, 0x44, 0x40, 0x20, 0x3c, 0x40, 0x40, 0x20, 0x7c, 0x1c, 0x20, 0x40, 0x20, 0x1c, 0x3c, 0x40,
+    0x30, 0x40, 0x3c, 0x44, 0x28, 0x10, 0x28, 0x44, 0x0c, 0x50, 0x50, 0x50, 0x3c, 0x44, 0x64, 0x54, 0x4c, 0x44, 0x00,
+    0x08, 0x36, 0x41, 0x00, 0x00, 0x00, 0x7f, 0x00, 0x00, 0x00, 0x41, 0x36, 0x08, 0x00, 0x08, 0x04, 0x08, 0x10, 0x08,
+};
+
+/// bitmap_font converts column-major glyphs to a packed atlas, with one cell of advance() pixels per character.
+/// Cells include spacing blank columns on the right of each glyph, and pixels are repeated scale times in both
+/// directions (the 5 x 7 font with scale 2 fills the 16 rows of a panel, with a 2 pixels margin).
+class bitmap_font {
+    public:
+    bitmap_font(
+        const uint8_t* columns,
+        uint8_t glyph_width,
+        uint8_t glyph_height,
+        uint8_t first,
+        uint16_t count,
+        uint8_t spacing = 1,
+        uint8_t scale = 1) :
+        _first(first),
+        _count(count),
+        _advance(static_cast<uint16_t>((glyph_width + spacing) * scale)),
+        _height(static_cast<uint16_t>(glyph_height * scale)) {
+        if (glyph_width == 0 || glyph_height == 0 || glyph_height > 8) {
+            throw std::logic_error("the glyph width must be larger than 0 and the glyph height in the range [1, 8]");
+        }
+        if (count == 0 || first + count > 256) {
+            throw std::logic_error("the glyphs must be in the range [0, 255]");
+        }
+        if (scale == 0 || static_cast<uint32_t>(_advance) * count > 65535) {
+            throw std::logic_error("the scale must be larger than 0 and the atlas smaller than 65536 pixels");
+        }
+        _stride = static_cast<uint16_t>((_advance * count + 7) / 8);
+        _atlas.resize(static_cast<std::size_t>(_stride) * _height, 0);
+        for (uint16_t glyph = 0; glyph < count; ++glyph) {
+            for (uint8_t column = 0; column < glyph_width; ++column) {
+                const auto bits = columns[glyph * glyph_width + column];
+                for (uint8_t row = 0; row < glyph_height; ++row) {
+                    if (((bits >> row) & 1) == 0) {
+                        continue;
+                    }
+                    for (uint8_t y = 0; y < scale; ++y) {
+                        for (uint8_t x = 0; x < scale; ++x) {
+                            const std::size_t atlas_x = glyph * _advance + column * scale + x;
+                            _atlas[(row * scale + y) * _stride + atlas_x / 8] |=
+                                static_cast<uint8_t>(0x80 >> (atlas_x % 8));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    bitmap_font(const bitmap_font&) = delete;
+    bitmap_font(bitmap_font&& other) = delete;
+    bitmap_font& operator=(const bitmap_font&) = delete;
+    bitmap_font& operator=(bitmap_font&& other) = delete;
+    virtual ~bitmap_font() {}
+
+    /// advance returns the width of a character cell in pixels.
+    uint16_t advance() const {
+        return _advance;
+    }
+
+    /// height returns the height of a character cell in pixels.
+    uint16_t height() const {
+        return _height;
+    }
+
+    /// atlas returns the glyph cells, side by side in character order.
+    packed_bitmap atlas() const {
+        return {static_cast<uint16_t>(_advance * _count), _height, _stride, _atlas.data()};
+    }
+
+    /// cell returns the index of the character's cell in the atlas, or -1 if the font does not have this character.
+    int32_t cell(char character) const {
+        const auto code = static_cast<uint8_t>(character);
+        return code >= _first && code - _first < _count ? code - _first : -1;
+    }
+
+    /// text_width returns the width of a string in pixels.
+    int32_t text_width(const std::string& text) const {
+        return static_cast<int32_t>(text.size()) * _advance;
+    }
+
+    protected:
+    const uint8_t _first;
+    const uint16_t _count;
+    const uint16_t _advance;
+    const uint16_t _height;
+    uint16_t _stride;
+    std::vector<uint8_t> _atlas;
+};
+
+/// font_5x7 returns the 5 x 7 font (printable ASCII characters, 6 pixels per character).
+inline const bitmap_font& font_5x7() {
+    static const bitmap_font font(font_5x7_columns.data(), 5, 7, 32, 95);
+    return font;
+}
+
+/// packed_raster draws on a packed frame, in the format consumed by led_panel::send.
+/// The frame has a brightness byte followed by the pixels of the whole display (32 * width x 16 * height, row major, 8
+/// pixels per byte, most significant bit first), hence horizontal neighbours on different panels are contiguous bits.
+/// Each row is a whole number of 32-bit big-endian words (one per horizontal panel). Drawing operations combine
+/// shifted source words with the frame words under a mask, instead of writing one byte per pixel and packing the
+/// result (8 times more memory than the display holds). All operations are clipped to the clip rectangle, which
+/// defaults to the whole frame, and the raster does not allocate memory after construction.
+class packed_raster {
+    public:
+    packed_raster(uint8_t width, uint8_t height) :
+        _width(32 * width),
+        _height(16 * height),
+        _row_bytes(4 * width),
+        _frame(64 * width * height + 1, 0),
+        _scratch(64 * width * height),
+        _text_row(4 * width + 12) {
+        if (width == 0 || height == 0) {
+            throw std::logic_error("width and height must be larger than 0");
+        }
+        _frame[0] = 255;
+        reset_clip();
+    }
+    packed_raster(const packed_raster&) = delete;
+    packed_raster(packed_raster&& other) = delete;
+    packed_raster& operator=(const packed_raster&) = delete;
+    packed_raster& operator=(packed_raster&& other) = delete;
+    virtual ~packed_raster() {}
+
+    /// width returns the frame width in pixels.
+    int32_t width() const {
+        return _width;
+    }
+
+    /// height returns the frame height in pixels.
+    int32_t height() const {
+        return _height;
+    }
+
+    /// frame returns the brightness byte followed by the packed pixels, to be passed to led_panel::send.
+    const std::vector<uint8_t>& frame() const {
+        return _frame;
+    }
+
+    /// pixels returns a pointer to the packed pixels, for instance to copy them to a shared memory slot.
+    uint8_t* pixels() {
+        return _frame.data() + 1;
+    }
+
+    /// set_brightness changes the brightness byte of the frame.
+    void set_brightness(uint8_t brightness) {
+        _frame[0] = brightness;
+    }
+
+    /// pixel returns true if the pixel at the given coordinates is on.
+    bool pixel(int32_t x, int32_t y) const {
+        return ((_frame[1 + y * _row_bytes + x / 8] >> (7 - x % 8)) & 1) == 1;
+    }
+
+    /// set_clip restricts the following operations to a rectangle, intersected with the frame.
+    void set_clip(int32_t x, int32_t y, int32_t width, int32_t height) {
+        _clip_left = std::clamp(x, 0, _width);
+        _clip_top = std::clamp(y, 0, _height);
+        _clip_right = std::max(_clip_left, std::clamp(x + width, 0, _width));
+        _clip_bottom = std::max(_clip_top, std::clamp(y + height, 0, _height));
+    }
+
+    /// reset_clip restores the default clip rectangle (the whole frame).
+    void reset_clip() {
+        set_clip(0, 0, _width, _height);
+    }
+
+    /// clear turns off the pixels of the clip rectangle.
+    void clear() {
+        fill_rect(_clip_left, _clip_top, _clip_right - _clip_left, _clip_bottom - _clip_top, false);
+    }
+
+    /// fill_rect combines a rectangle of constant pixels with the frame.
+    /// For instance, on = false with raster_op::copy turns the pixels off, and on = true with raster_op::bitwise_xor
+    /// inverts them.
+    void fill_rect(
+        int32_t x,
+        int32_t y,
+        int32_t width,
+        int32_t height,
+        bool on = true,
+        raster_op op = raster_op::copy) {
+        int32_t source_x = 0;
+        int32_t source_y = 0;
+        if (!clip(source_x, source_y, x, y, width, height)) {
+            return;
+        }
+        dispatch(op, [&](auto operation) {
+            for (auto row = y; row < y + height; ++row) {
+                fill_row<decltype(operation)::value>(pixels() + row * _row_bytes, x, width, on ? 0xffffffffu : 0u);
+            }
+        });
+    }
+
+    /// blit combines a bitmap with the frame, with its top-left pixel at (x, y).
+    void blit(const packed_bitmap& source, int32_t x, int32_t y, raster_op op = raster_op::bitwise_or) {
+        blit(source, 0, 0, source.width, source.height, x, y, op);
+    }
+
+    /// blit combines a rectangle of a bitmap (for instance a sprite sheet cell) with the frame.
+    void blit(
+        const packed_bitmap& source,
+        int32_t source_x,
+        int32_t source_y,
+        int32_t width,
+        int32_t height,
+        int32_t x,
+        int32_t y,
+        raster_op op = raster_op::bitwise_or) {
+        if (source_x < 0) {
+            width += source_x;
+            x -= source_x;
+            source_x = 0;
+        }
+        if (source_y < 0) {
+            height += source_y;
+            y -= source_y;
+            source_y = 0;
+        }
+        width = std::min(width, static_cast<int32_t>(source.width) - source_x);
+        height = std::min(height, static_cast<int32_t>(source.height) - source_y);
+        if (!clip(source_x, source_y, x, y, width, height)) {
+            return;
+        }
+        dispatch(op, [&](auto operation) {
+            for (int32_t row = 0; row < height; ++row) {
+                blit_row<decltype(operation)::value>(
+                    source.data + (source_y + row) * source.stride,
+                    source.stride,
+                    source_x,
+                    pixels() + (y + row) * _row_bytes,
+                    x,
+                    width);
+            }
+        });
+    }
+
+    /// draw_text draws a string with its top-left pixel at (x, y), and returns the x coordinate after the last cell.
+    /// The whole cells (glyphs and spacing) are combined with the frame, hence raster_op::copy overwrites the
+    /// previous text. Characters that the font does not have are drawn as blank cells. Only the characters that
+    /// intersect the clip rectangle are read, thus a ticker may draw a long string at a negative x every frame.
+    /// Cells up to 32 pixels wide are concatenated into a word-aligned row buffer, so that each frame word is
+    /// combined once per row rather than once per glyph.
+    int32_t draw_text(
+        const bitmap_font& font,
+        const std::string& text,
+        int32_t x,
+        int32_t y,
+        raster_op op = raster_op::bitwise_or) {
+        const int32_t advance = font.advance();
+        const auto atlas = font.atlas();
+        const auto text_end = x + font.text_width(text);
+        if (advance > 32) {
+            for (const auto character : text) {
+                if (x < _clip_right && x + advance > _clip_left) {
+                    const auto cell = font.cell(character);
+                    if (cell < 0) {
+                        fill_rect(x, y, advance, font.height(), false, op);
+                    } else {
+                        blit(atlas, cell * advance, 0, advance, font.height(), x, y, op);
+                    }
+                }
+                x += advance;
+            }
+            return text_end;
+        }
+        const auto left = std::max(x, _clip_left);
+        const auto right = std::min(text_end, _clip_right);
+        const auto top = std::max(y, _clip_top);
+        const auto bottom = std::min(y + static_cast<int32_t>(font.height()), _clip_bottom);
+        if (left >= right || top >= bottom) {
+            return text_end;
+        }
+        const auto first_character = (left - x) / advance;
+        const auto last_character = (right - 1 - x) / advance;
+        // the row buffer starts one word before the first frame word, hence positions are positive
+        const auto origin = (left / 32 - 1) * 32;
+        dispatch(op, [&](auto operation) {
+            for (auto row = top; row < bottom; ++row) {
+                const auto atlas_row = atlas.data + (row - y) * atlas.stride;
+                const auto position = x + first_character * advance - origin;
+                auto word = position / 32;
+                auto count = position % 32;
+                uint64_t bits = 0;
+                for (auto index = first_character; index <= last_character; ++index) {
+                    const auto cell = font.cell(text[index]);
+                    if (cell >= 0) {
+                        const auto cell_bits = load_bits(atlas_row, atlas.stride, cell * advance) >> (32 - advance);
+                        bits |= static_cast<uint64_t>(cell_bits) << (64 - count - advance);
+                    }
+                    count += advance;
+                    if (count >= 32) {
+                        store_word(_text_row.data() + word * 4, static_cast<uint32_t>(bits >> 32));
+                        ++word;
+                        bits <<= 32;
+                        count -= 32;
+                    }
+                }
+                if (count > 0) {
+                    store_word(_text_row.data() + word * 4, static_cast<uint32_t>(bits >> 32));
+                }
+                blit_row<decltype(operation)::value>(
+                    _text_row.data(),
+                    static_cast<int32_t>(_text_row.size()),
+                    left - origin,
+                    pixels() + row * _row_bytes,
+                    left,
+                    right - left);
+            }
+        });
+        return text_end;
+    }
+
+    /// scroll moves the pixels of the clip rectangle by dx columns (positive values move them right) and dy rows
+    /// (positive values move them down). Rows are shifted as big-endian word sequences, hence pixels cross panel
+    /// boundaries. Pixels that leave the rectangle re-enter on the other side if wrap is true, otherwise vacated
+    /// pixels are turned off. Pixels outside the clip rectangle are neither moved nor modified.
+    void scroll(int32_t dx, int32_t dy, bool wrap = false) {
+        const auto width = _clip_right - _clip_left;
+        const auto height = _clip_bottom - _clip_top;
+        if (width == 0 || height == 0) {
+            return;
+        }
+        if (wrap) {
+            dx = ((dx % width) + width) % width;
+            dy = ((dy % height) + height) % height;
+        }
+        // the moved segment is copied from the source row, the entering segment wraps around or is turned off
+        if (!wrap) {
+            dx = std::clamp(dx, -width, width);
+        }
+        const auto moved_source_x = _clip_left + std::max(-dx, 0);
+        const auto moved_x = _clip_left + std::max(dx, 0);
+        const auto moved_width = width - std::abs(dx);
+        const auto entering_source_x = _clip_right - dx;
+        const auto entering_x = dx >= 0 ? _clip_left : _clip_right + dx;
+        const auto entering_width = std::abs(dx);
+        const auto first_byte = _clip_top * _row_bytes;
+        std::copy(
+            _frame.begin() + 1 + first_byte,
+            _frame.begin() + 1 + first_byte + height * _row_bytes,
+            _scratch.begin() + first_byte);
+        for (auto row = _clip_top; row < _clip_bottom; ++row) {
+            auto destination = pixels() + row * _row_bytes;
+            auto source_row = row - dy;
+            if (wrap && source_row < _clip_top) {
+                source_row += height;
+            }
+            if (source_row < _clip_top || source_row >= _clip_bottom) {
+                fill_row<raster_op::copy>(destination, _clip_left, width, 0);
+                continue;
+            }
+            const auto source = _scratch.data() + source_row * _row_bytes;
+            if (moved_width > 0) {
+                blit_row<raster_op::copy>(source, _row_bytes, moved_source_x, destination, moved_x, moved_width);
+            }
+            if (entering_width > 0) {
+                if (wrap) {
+                    blit_row<raster_op::copy>(
+                        source, _row_bytes, entering_source_x, destination, entering_x, entering_width);
+                } else {
+                    fill_row<raster_op::copy>(destination, entering_x, entering_width, 0);
+                }
+            }
+        }
+    }
+
+    protected:
+    /// clip intersects a destination rectangle with the clip rectangle, and moves the source origin accordingly.
+    /// It returns false if the intersection is empty.
+    bool clip(int32_t& source_x, int32_t& source_y, int32_t& x, int32_t& y, int32_t& width, int32_t& height) const {
+        if (x < _clip_left) {
+            width -= _clip_left - x;
+            source_x += _clip_left - x;
+            x = _clip_left;
+        }
+        if (y < _clip_top) {
+            height -= _clip_top - y;
+            source_y += _clip_top - y;
+            y = _clip_top;
+        }
+        width = std::min(width, _clip_right - x);
+        height = std::min(height, _clip_bottom - y);
+        return width > 0 && height > 0;
+    }
+
+    /// load_word reads the big-endian frame word at the given address.
+    static uint32_t load_word(const uint8_t* bytes) {
+        uint32_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        word = __builtin_bswap32(word);
+#endif
+        return word;
+    }
+
+    /// store_word writes a big-endian frame word at the given address.
+    static void store_word(uint8_t* bytes, uint32_t word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        word = __builtin_bswap32(word);
+#endif
+        std::memcpy(bytes, &word, sizeof(word));
+    }
+
+    /// load_bits returns the 32 pixels of a source row that start at the given bit offset (offset >= 0), most
+    /// significant bit first. Bytes after the end of the row (size bytes) read as 0.
+    static uint32_t load_bits(const uint8_t* row, int32_t size, int32_t offset) {
+        const auto first = static_cast<uint32_t>(offset) / 8;
+        const auto shift = static_cast<uint32_t>(offset) % 8;
+        if (first + 8 <= static_cast<uint32_t>(size)) {
+            uint64_t bits;
+            std::memcpy(&bits, row + first, sizeof(bits));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            bits = __builtin_bswap64(bits);
+#endif
+            return static_cast<uint32_t>(bits >> (32 - shift));
+        }
+        uint64_t bits = 0;
+        for (auto index = first; index < first + 5; ++index) {
+            bits = (bits << 8) | (index < static_cast<uint32_t>(size) ? row[index] : 0);
+        }
+        return static_cast<uint32_t>(bits >> (8 - shift));
+    }
+
+    /// dispatch calls function with the operation as a compile-time constant, to specialize the row loops.
+    template <typename Function>
+    static void dispatch(raster_op op, Function function) {
+        switch (op) {
+            case raster_op::copy:
+                function(std::integral_constant<raster_op, raster_op::copy>());
+                break;
+            case raster_op::bitwise_or:
+                function(std::integral_constant<raster_op, raster_op::bitwise_or>());
+                break;
+            case raster_op::bitwise_xor:
+                function(std::integral_constant<raster_op, raster_op::bitwise_xor>());
+                break;
+            case raster_op::bitwise_and:
+                function(std::integral_constant<raster_op, raster_op::bitwise_and>());
+                break;
+        }
+    }
+
+    /// combine applies an operation to the pixels of a frame word selected by mask.
+    template <raster_op op>
+    static uint32_t combine(uint32_t word, uint32_t source, uint32_t mask) {
+        switch (op) {
+            case raster_op::copy:
+                return (word & ~mask) | (source & mask);
+            case raster_op::bitwise_or:
+                return word | (source & mask);
+            case raster_op::bitwise_xor:
+                return word ^ (source & mask);
+            case raster_op::bitwise_and:
+                return word & (source | ~mask);
+        }
+        return word;
+    }
+
+    /// span_mask selects the bits [begin, end) of a word, counted from the most significant bit.
+    static uint32_t span_mask(int32_t begin, int32_t end) {
+        return (0xffffffffu >> begin) & ~(end == 32 ? 0u : 0xffffffffu >> end);
+    }
+
+    /// fill_row combines the constant source word with the pixels [x, x + width) of a frame row (width > 0).
+    template <raster_op op>
+    static void fill_row(uint8_t* row, int32_t x, int32_t width, uint32_t source) {
+        const auto first = x / 32;
+        const auto last = (x + width - 1) / 32;
+        const auto begin = x - first * 32;
+        const auto end = x + width - last * 32;
+        if (first == last) {
+            store_word(row + first * 4, combine<op>(load_word(row + first * 4), source, span_mask(begin, end)));
+            return;
+        }
+        store_word(row + first * 4, combine<op>(load_word(row + first * 4), source, span_mask(begin, 32)));
+        for (auto word = first + 1; word < last; ++word) {
+            store_word(row + word * 4, combine<op>(load_word(row + word * 4), source, 0xffffffffu));
+        }
+        store_word(row + last * 4, combine<op>(load_word(row + last * 4), source, span_mask(0, end)));
+    }
+
+    /// blit_row combines the source pixels [source_x, source_x + width) with the frame pixels [x, x + width)
+    /// (width > 0). The source row (size bytes) must not overlap the frame row.
+    template <raster_op op>
+    static void blit_row(
+        const uint8_t* source,
+        int32_t size,
+        int32_t source_x,
+        uint8_t* row,
+        int32_t x,
+        int32_t width) {
+        const auto first = x / 32;
+        const auto last = (x + width - 1) / 32;
+        const auto begin = x - first * 32;
+        const auto end = x + width - last * 32;
+        const auto first_bits = load_bits(source, size, source_x) >> begin;
+        if (first == last) {
+            store_word(row + first * 4, combine<op>(load_word(row + first * 4), first_bits, span_mask(begin, end)));
+            return;
+        }
+        store_word(row + first * 4, combine<op>(load_word(row + first * 4), first_bits, span_mask(begin, 32)));
+        // the source offset of each following word is source_x + (word * 32 - x)
+        auto offset = source_x + 32 - begin;
+        for (auto word = first + 1; word < last; ++word, offset += 32) {
+            const auto bits = load_bits(source, size, offset);
+            store_word(row + word * 4, combine<op>(load_word(row + word * 4), bits, 0xffffffffu));
+        }
+        store_word(
+            row + last * 4, combine<op>(load_word(row + last * 4), load_bits(source, size, offset), span_mask(0, end)));
+    }
+
+    const int32_t _width;
+    const int32_t _height;
+    const int32_t _row_bytes;
+    std::vector<uint8_t> _frame;
+    std::vector<uint8_t> _scratch;
+    std::vector<uint8_t> _text_row;
+    int32_t _clip_left;
+    int32_t _clip_top;
+    int32_t _clip_right;
+    int32_t _clip_bottom;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+
+/// realtime_profile configures the process and the transmit thread for deterministic transfers.
+/// Byte handshakes are sensitive to preemptions and page faults: a transfer that stalls for more than 8 display
+/// periods is reset by the firmware (frame_tick timeout), and shorter stalls delay the frame.
+struct realtime_profile {
+    /// lock_memory locks the current and future pages of the process in RAM (mlockall), hence transfers never wait
+    /// for a page fault.
+    bool lock_memory;
+
+    /// priority is the SCHED_FIFO priority of the transmit thread, from 1 to 99, or 0 to keep the default scheduler.
+    /// A real-time thread is only preempted by threads with a higher priority and by interrupts.
+    int32_t priority;
+
+    /// core is the core of the transmit thread, or -1 to let the kernel choose.
+    int32_t core;
+};
+
+/// lock_memory locks the current and future pages of the process in RAM.
+/// It requires CAP_IPC_LOCK or a large enough memlock limit (ulimit -l).
+inline void lock_memory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        throw std::runtime_error(
+            std::string("locking the memory failed (") + std::strerror(errno)
+            + "), run as root or raise the memlock limit");
+    }
+}
+
+/// set_thread_scheduling gives a thread the SCHED_FIFO policy if priority is larger than 0, and pins it to a core if
+/// core is not negative. Threads created afterwards by this thread inherit its policy and core.
+/// A real-time priority requires CAP_SYS_NICE or a large enough rtprio limit (ulimit -r).
+inline void set_thread_scheduling(pthread_t thread, int32_t priority, int32_t core) {
+    if (priority > 0) {
+        if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO)) {
+            throw std::logic_error("the real-time priority must be in the range [1, 99]");
+        }
+        sched_param parameters{};
+        parameters.sched_priority = priority;
+        const auto error = pthread_setschedparam(thread, SCHED_FIFO, &parameters);
+        if (error != 0) {
+            throw std::runtime_error(
+                "setting the real-time priority " + std::to_string(priority) + " failed (" + std::strerror(error)
+                + "), run as root or raise the rtprio limit");
+        }
+    }
+    if (core >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpus) != 0) {
+            throw std::runtime_error("the transmit thread could not be pinned to core " + std::to_string(core));
+        }
+    }
+}
+
+/// apply_realtime_profile locks the memory if requested, and sets the scheduling of the calling thread.
+inline void apply_realtime_profile(const realtime_profile& profile) {
+    if (profile.lock_memory) {
+        lock_memory();
+    }
+    set_thread_scheduling(pthread_self(), profile.priority, profile.core);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/// futex_wait blocks while word is equal to expected, until futex_wake is called or the timeout expires.
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, const timespec* timeout) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+/// futex_wake wakes all the threads and processes waiting on word.
+inline void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/// shared_frame_ring is a single-producer single-consumer frame queue in a POSIX shared memory object
+/// (/dev/shm/name), which lets producers write frames in place instead of piping them to led_panel_sink.
+///
+/// The object starts with a 64 bytes header (native endianness):
+///     - offset  0: magic (uint32, 0x4c505352)
+///     - offset  4: frame_size (uint32), the number of bytes per frame, including the brightness byte
+///     - offset  8: capacity (uint32), the number of slots
+///     - offset 12: stride (uint32), the distance between slots in bytes (frame_size rounded up to 64)
+///     - offset 16: write (uint32), the number of published frames, modulo 2^32
+///     - offset 20: read (uint32), the number of consumed frames, modulo 2^32
+///     - offset 24: closed (uint32), set to 1 by the producer after its last frame
+/// The slots follow the header. The next frame is written to slot write % capacity, then the producer increments
+/// write and wakes the futex waiters on write. The consumer increments read when it is done with a slot and wakes the
+/// futex waiters on read. The Python helper (scripts/led_panel.py) implements the producer side.
+class shared_frame_ring {
+    public:
+    /// header is the memory layout of the first 64 bytes.
+    struct header {
+        uint32_t magic;
+        uint32_t frame_size;
+        uint32_t capacity;
+        uint32_t stride;
+        std::atomic<uint32_t> write;
+        std::atomic<uint32_t> read;
+        std::atomic<uint32_t> closed;
+        uint32_t reserved[9];
+    };
+    static_assert(sizeof(header) == 64, "the shared ring header must be 64 bytes long");
+
+    /// magic_number identifies an initialized ring.
+    static constexpr uint32_t magic_number = 0x4c505352;
+
+    /// shared_frame_ring opens the shared memory object name, or creates it with the given capacity if it does not
+    /// exist. In the latter case, the object is removed by the destructor.
+    shared_frame_ring(const std::string& name, uint32_t frame_size, uint32_t capacity = 4) :
+        _name(name[0] == '/' ? name : "/" + name), _created(false) {
+        auto file_descriptor = shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (file_descriptor >= 0) {
+            _created = true;
+            _size = sizeof(header) + capacity * stride(frame_size);
+            if (ftruncate(file_descriptor, _size) < 0) {
+                ::close(file_descriptor);
+                shm_unlink(_name.c_str());
+                throw std::runtime_error("the shared memory object '" + _name + "' could not be resized");
+            }
+        } else {
+            file_descriptor = shm_open(_name.c_str(), O_RDWR, 0600);
+            if (file_descriptor < 0) {
+                throw std::runtime_error("the shared memory object '" + _name + "' could not be opened");
+            }
+            struct stat status;
+            fstat(file_descriptor, &status);
+            _size = status.st_size;
+        }
+        auto map = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+        ::close(file_descriptor);
+        if (map == MAP_FAILED) {
+            if (_created) {
+                shm_unlink(_name.c_str());
+            }
+            throw std::runtime_error("mmap failed");
+        }
+        _header = reinterpret_cast<header*>(map);
+        _slots = reinterpret_cast<uint8_t*>(map) + sizeof(header);
+        if (_created) {
+            _header->frame_size = frame_size;
+            _header->capacity = capacity;
+            _header->stride = stride(frame_size);
+            _header->write.store(0);
+            _header->read.store(0);
+            _header->closed.store(0);
+            _header->magic = magic_number;
+        } else if (
+            _size < sizeof(header) || _header->magic != magic_number || _header->frame_size != frame_size
+            || _size < sizeof(header) + static_cast<std::size_t>(_header->capacity) * _header->stride) {
+            munmap(map, _size);
+            throw std::runtime_error("the shared memory object '" + _name + "' does not match the display");
+        }
+    }
+    shared_frame_ring(const shared_frame_ring&) = delete;
+    shared_frame_ring(shared_frame_ring&& other) = delete;
+    shared_frame_ring& operator=(const shared_frame_ring&) = delete;
+    shared_frame_ring& operator=(shared_frame_ring&& other) = delete;
+    virtual ~shared_frame_ring() {
+        munmap(_header, _size);
+        if (_created) {
+            shm_unlink(_name.c_str());
+        }
+    }
+
+    /// acquire_read waits for a frame and returns a pointer to its slot.
+    /// It returns nullptr if the ring is empty and closed.
+    const uint8_t* acquire_read() {
+        const auto read = _header->read.load(std::memory_order_relaxed);
+        for (;;) {
+            const auto write = _header->write.load(std::memory_order_acquire);
+            if (write != read) {
+                return _slots + static_cast<std::size_t>(read % _header->capacity) * _header->stride;
+            }
+            if (_header->closed.load(std::memory_order_acquire) != 0) {
+                return nullptr;
+            }
+            const timespec timeout = {0, 100000000};
+            futex_wait(_header->write, write, &timeout);
+        }
+    }
+
+    /// release_read frees the slot returned by acquire_read.
+    void release_read() {
+        _header->read.fetch_add(1, std::memory_order_release);
+        futex_wake(_header->read);
+    }
+
+    /// acquire_write waits for a free slot and returns a pointer to it.
+    uint8_t* acquire_write() {
+        const auto write = _header->write.load(std::memory_order_relaxed);
+        for (;;) {
+            const auto read = _header->read.load(std::memory_order_acquire);
+            if (write - read < _header->capacity) {
+                return _slots + static_cast<std::size_t>(write % _header->capacity) * _header->stride;
+            }
+            const timespec timeout = {0, 100000000};
+            futex_wait(_header->read, read, &timeout);
+        }
+    }
+
+    /// release_write publishes the slot returned by acquire_write.
+    void release_write() {
+        _header->write.fetch_add(1, std::memory_order_release);
+        futex_wake(_header->write);
+    }
+
+    /// close signals the consumer that no more frames will be published.
+    void close() {
+        _header->closed.store(1, std::memory_order_release);
+        futex_wake(_header->write);
+    }
+
+    protected:
+    /// stride rounds a frame size up to a multiple of 64 bytes, so that slots start on cache lines.
+    static uint32_t stride(uint32_t frame_size) {
+        return (frame_size + 63) / 64 * 64;
+    }
+
+    const std::string _name;
+    bool _created;
+    std::size_t _size;
+    header* _header;
+    uint8_t* _slots;
+};
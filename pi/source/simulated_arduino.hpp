@@ -0,0 +1,480 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+/// simulated_arduino emulates the Raspberry Pi GPIO registers and the Arduino firmware (arduino/arduino.c).
+/// The registers live in an anonymous memory mapping. A thread plays the firmware's request / acknowledge state
+/// machine, its cyclic frame buffer (including plane groups, delta transfers and the buffer depth) and its frame_tick
+/// timeouts. The display interrupt is emulated with the steady clock.
+class simulated_arduino {
+    public:
+    /// statistics summarizes the firmware activity.
+    struct statistics {
+        /// frames is the number of frames written to the frame buffer.
+        uint64_t frames;
+
+        /// handshakes is the number of request / acknowledge round-trips.
+        uint64_t handshakes;
+
+        /// timeouts is the number of transfers interrupted by the frame_tick timeout.
+        uint64_t timeouts;
+
+        /// presented is the number of times the display moved to the next frame buffer slot.
+        uint64_t presented;
+
+        /// looped is the number of times the display returned to the first slot of a multi-slot group.
+        uint64_t looped;
+
+        /// transfer_duration is the total time between the first and last pixel bytes of the written frames.
+        /// It does not include the brightness byte, which waits for a free frame buffer slot.
+        std::chrono::nanoseconds transfer_duration;
+
+        /// resets is the number of firmware restarts (see unplug).
+        uint64_t resets;
+    };
+
+    /// set_offset is the gpios set register offset.
+    static constexpr uint8_t set_offset = 7;
+
+    /// clear_offset is the gpios clear register offset.
+    static constexpr uint8_t clear_offset = 10;
+
+    /// level_offset is the gpios level register offset.
+    static constexpr uint8_t level_offset = 13;
+
+    /// display_period is the firmware's display period (see arduino/arduino.c).
+    static constexpr std::chrono::nanoseconds display_period = std::chrono::nanoseconds(9984000);
+
+    simulated_arduino(uint8_t width, uint8_t height, std::chrono::nanoseconds period = display_period) :
+        _frame_size(64 * width * height),
+        _period(period),
+        _yield(std::thread::hardware_concurrency() < 2),
+        _frame_buffer(8 * (_frame_size + 1), 0),
+        _delta_header((_frame_size / delta_block_size + 15) / 16 * 2),
+        _transfer_size(_frame_size),
+        _frames(0),
+        _handshakes(0),
+        _timeouts(0),
+        _presented(0),
+        _looped(0),
+        _transfer_duration(0),
+        _resets(0),
+        _unplugged_until(0),
+        _running(true) {
+        auto map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            throw std::logic_error("mmap failed");
+        }
+        _registers = new (map) std::array<std::atomic<uint32_t>, size / sizeof(uint32_t)>();
+        _loop = std::thread([this]() { run(); });
+    }
+    simulated_arduino(const simulated_arduino&) = delete;
+    simulated_arduino(simulated_arduino&& other) = delete;
+    simulated_arduino& operator=(const simulated_arduino&) = delete;
+    simulated_arduino& operator=(simulated_arduino&& other) = delete;
+    virtual ~simulated_arduino() {
+        _running.store(false, std::memory_order_relaxed);
+        _loop.join();
+        munmap(_registers, size);
+    }
+
+    /// registers returns the emulated GPIO registers.
+    std::atomic<uint32_t>* registers() {
+        return _registers->data();
+    }
+
+    /// yield is true if the simulation shares a single core with the sender, in which case busy loops must yield.
+    bool yield() const {
+        return _yield;
+    }
+
+    /// record_presentations enables or disables the recording of presentation times.
+    /// When enabled, the display records the steady clock time at which it moves to the first slot of each group,
+    /// hence the n-th recorded time corresponds to the n-th group written after the constructor.
+    void record_presentations(bool enabled) {
+        std::lock_guard<std::mutex> lock(_presentations_mutex);
+        _record_presentations = enabled;
+    }
+
+    /// presentations returns the recorded presentation times and clears them.
+    std::vector<std::chrono::steady_clock::time_point> presentations() {
+        std::lock_guard<std::mutex> lock(_presentations_mutex);
+        std::vector<std::chrono::steady_clock::time_point> result;
+        result.swap(_presentations);
+        return result;
+    }
+
+    /// unplug emulates a cable unplugged for the given duration: the firmware ignores the request pin and leaves the
+    /// acknowledge pin unchanged, then restarts with an empty frame buffer (the Arduino resets when it is plugged
+    /// back).
+    void unplug(std::chrono::nanoseconds duration) {
+        _unplugged_until.store(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                (std::chrono::steady_clock::now() + duration).time_since_epoch())
+                .count(),
+            std::memory_order_relaxed);
+    }
+
+    /// snapshot returns the current statistics.
+    statistics snapshot() const {
+        return {
+            _frames.load(std::memory_order_relaxed),
+            _handshakes.load(std::memory_order_relaxed),
+            _timeouts.load(std::memory_order_relaxed),
+            _presented.load(std::memory_order_relaxed),
+            _looped.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(_transfer_duration.load(std::memory_order_relaxed)),
+            _resets.load(std::memory_order_relaxed),
+        };
+    }
+
+    protected:
+    /// size is the number of bytes of the emulated register block.
+    static constexpr std::size_t size = 180;
+
+    /// request_pin is the GPIO connected to the Arduino's pi_request_pin.
+    static constexpr uint32_t request_pin = 27;
+
+    /// acknowledge_pin is the GPIO connected to the Arduino's pi_acknowledge_pin.
+    static constexpr uint32_t acknowledge_pin = 22;
+
+    /// delta_block_size is the number of bytes per delta block.
+    static constexpr uint16_t delta_block_size = 16;
+
+    /// bit_to_gpio associates the Arduino's PIND bits with the Raspberry Pi GPIOs (see tools/generate_byte_to_mask.py).
+    static constexpr std::array<uint8_t, 8> bit_to_gpio = {20, 21, 26, 16, 19, 13, 6, 5};
+
+    /// pind reads the Arduino data port from a level register value.
+    static uint8_t pind(uint32_t level) {
+        uint8_t result = 0;
+        for (uint8_t bit = 0; bit < 8; ++bit) {
+            result |= static_cast<uint8_t>(((level >> bit_to_gpio[bit]) & 1) << bit);
+        }
+        return result;
+    }
+
+    /// acknowledge drives the acknowledge pin.
+    void acknowledge(bool value) {
+        if (value) {
+            (*_registers)[level_offset].fetch_or(1u << acknowledge_pin);
+        } else {
+            (*_registers)[level_offset].fetch_and(~(1u << acknowledge_pin));
+        }
+    }
+
+    /// count increments a statistics counter, which is only written by the firmware thread.
+    static void count(std::atomic<uint64_t>& counter, uint64_t increment = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + increment, std::memory_order_relaxed);
+    }
+
+    /// commit_frame publishes the slot being written if group_end is not 0 (see commit_frame in arduino/arduino.c).
+    void commit_frame(uint8_t group_end) {
+        _group_end[_write] = group_end;
+        _write = (_write + 1) % 8;
+        if (group_end) {
+            _ready = _write;
+        }
+    }
+
+    /// slot_available returns true if the slot being written may receive a transfer (see slot_available in
+    /// arduino/arduino.c).
+    bool slot_available() const {
+        if (_write == _first) {
+            return false;
+        }
+        return !_group_end[(_write + 7) % 8] || (_write - _read + 7) % 8 < _buffer_depth;
+    }
+
+    /// receive_brightness stores the brightness byte, and copies the previous slot before a delta transfer (see
+    /// receive_brightness in arduino/arduino.c).
+    void receive_brightness(uint8_t byte) {
+        const auto slot = _frame_buffer.begin() + _write * (_frame_size + 1);
+        slot[0] = byte;
+        if (_delta) {
+            const auto previous = _frame_buffer.begin() + ((_write + 7) % 8) * (_frame_size + 1);
+            std::copy(std::next(previous), previous + _frame_size + 1, std::next(slot));
+            _transfer_size = static_cast<uint16_t>(_delta_header.size());
+        } else {
+            _transfer_size = _frame_size;
+        }
+    }
+
+    /// next_delta_offset returns the slot index of the first changed block at or after offset, or frame_size + 1.
+    uint16_t next_delta_offset(uint16_t offset) const {
+        for (uint16_t block = (offset - 1) / delta_block_size; block < _frame_size / delta_block_size; ++block) {
+            if ((_delta_header[block / 8] >> (block % 8)) & 1) {
+                return block * delta_block_size + 1;
+            }
+        }
+        return _frame_size + 1;
+    }
+
+    /// slot_checksum computes the Fletcher-16 checksum (8-bit sums) of the slot being written (see slot_checksum in
+    /// arduino/arduino.c).
+    uint16_t slot_checksum() const {
+        uint8_t sum = 0;
+        uint8_t sum_of_sums = 0;
+        const auto slot = _frame_buffer.begin() + _write * (_frame_size + 1);
+        for (uint16_t index = 0; index < _frame_size + 1; ++index) {
+            sum = static_cast<uint8_t>(sum + slot[index]);
+            sum_of_sums = static_cast<uint8_t>(sum_of_sums + sum);
+        }
+        return static_cast<uint16_t>((sum_of_sums << 8) | sum);
+    }
+
+    /// receive_byte stores a byte of a full or delta transfer (see receive_byte in arduino/arduino.c).
+    void receive_byte(uint16_t read_index, uint8_t byte) {
+        const auto slot = _write * (_frame_size + 1);
+        if (!_delta) {
+            _frame_buffer[slot + read_index] = byte;
+        } else if (read_index <= _delta_header.size()) {
+            _delta_header[read_index - 1] = static_cast<uint8_t>(~byte);
+            if (read_index == _delta_header.size()) {
+                for (uint16_t block = 0; block < _frame_size / delta_block_size; ++block) {
+                    if ((_delta_header[block / 8] >> (block % 8)) & 1) {
+                        _transfer_size += delta_block_size;
+                    }
+                }
+                _delta_offset = next_delta_offset(1);
+            }
+        } else {
+            _frame_buffer[slot + _delta_offset] = byte;
+            ++_delta_offset;
+            if ((_delta_offset - 1) % delta_block_size == 0) {
+                _delta_offset = next_delta_offset(_delta_offset);
+            }
+        }
+    }
+
+    /// reset restores the firmware's initial state.
+    void reset() {
+        _read = 0;
+        _write = 1;
+        _group_end.fill(1);
+        _ready = 1;
+        _first = 0;
+        _buffer_depth = 7;
+        _delta = false;
+        std::fill(_frame_buffer.begin(), _frame_buffer.end(), 0);
+        acknowledge(false);
+        count(_resets);
+    }
+
+    /// run mirrors the firmware's main loop, and calls the display interrupt when a period has elapsed.
+    void run() {
+        uint8_t read_state = 0;
+        uint16_t read_index = 0;
+        uint8_t previous_frame_tick = 0;
+        uint8_t frame_tick = 0;
+        const auto begin = std::chrono::steady_clock::now();
+        auto next_tick = begin + _period;
+        std::chrono::steady_clock::time_point transfer_begin;
+        auto unplugged = false;
+        while (_running.load(std::memory_order_relaxed)) {
+            if (_yield) {
+                std::this_thread::yield();
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count()
+                < _unplugged_until.load(std::memory_order_relaxed)) {
+                unplugged = true;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            if (unplugged) {
+                unplugged = false;
+                reset();
+                read_state = 0;
+                previous_frame_tick = frame_tick;
+                next_tick = now + _period;
+            }
+            while (now >= next_tick) {
+                ++frame_tick;
+                const uint8_t next = (_read + 1) % 8;
+                if (next != _ready) {
+                    if (_group_end[_read]) {
+                        _first = next;
+                        std::lock_guard<std::mutex> lock(_presentations_mutex);
+                        if (_record_presentations) {
+                            _presentations.push_back(next_tick);
+                        }
+                    }
+                    _read = next;
+                    count(_presented);
+                } else if (_read != _first) {
+                    _read = _first;
+                    count(_looped);
+                }
+                next_tick += _period;
+            }
+            const auto level = (*_registers)[level_offset].load();
+            const auto request = (level >> request_pin) & 1;
+            switch (read_state) {
+                case 0:
+                case 1:
+                    if (read_state == 1 || request) {
+                        if (!slot_available()) {
+                            read_state = 1;
+                        } else {
+                            receive_brightness(pind(level));
+                            acknowledge(true);
+                            count(_handshakes);
+                            previous_frame_tick = frame_tick;
+                            read_index = 1;
+                            read_state = 2;
+                        }
+                    } else if (_delta && static_cast<uint8_t>(frame_tick - previous_frame_tick) > 8) {
+                        _delta = false;
+                    }
+                    break;
+                case 2:
+                    if (request != (read_index & 1)) {
+                        receive_byte(read_index, pind(level));
+                        acknowledge((read_index & 1) == 0);
+                        count(_handshakes);
+                        if (read_index == 1) {
+                            transfer_begin = now;
+                        }
+                        if (read_index < _transfer_size) {
+                            previous_frame_tick = frame_tick;
+                            ++read_index;
+                        } else {
+                            count(_frames);
+                            count(
+                                _transfer_duration,
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(now - transfer_begin).count());
+                            read_state = 3;
+                        }
+                    } else if (static_cast<uint8_t>(frame_tick - previous_frame_tick) > 8) {
+                        acknowledge(false);
+                        count(_timeouts);
+                        _delta = false;
+                        read_state = 0;
+                    }
+                    break;
+                case 3:
+                    if (request == 0) {
+                        const auto trailer = pind(level);
+                        const auto echo = ((trailer >> 5) & 1) == 0;
+                        if (echo) {
+                            _echo_checksum = slot_checksum();
+                        }
+                        commit_frame(trailer & 1);
+                        _delta = ((trailer >> 1) & 1) == 0;
+                        const auto depth = (~trailer >> 2) & 7;
+                        _buffer_depth = static_cast<uint8_t>(depth == 0 ? 7 : depth);
+                        previous_frame_tick = frame_tick;
+                        acknowledge(false);
+                        count(_handshakes);
+                        read_index = 0;
+                        read_state = echo ? 5 : 0;
+                    } else if (static_cast<uint8_t>(frame_tick - previous_frame_tick) > 8) {
+                        commit_frame(1);
+                        acknowledge(false);
+                        count(_timeouts);
+                        _delta = false;
+                        read_state = 4;
+                    }
+                    break;
+                case 4:
+                    if (request == 0) {
+                        read_state = 0;
+                    }
+                    break;
+                case 5:
+                    // read_index counts the echo edges (see slot_checksum in arduino/arduino.c)
+                    if (request != (read_index & 1)) {
+                        acknowledge(read_index < 16 && ((_echo_checksum >> (15 - read_index)) & 1));
+                        if (read_index < 16) {
+                            previous_frame_tick = frame_tick;
+                            ++read_index;
+                        } else {
+                            read_state = 4;
+                        }
+                    } else if (static_cast<uint8_t>(frame_tick - previous_frame_tick) > 8) {
+                        acknowledge(false);
+                        count(_timeouts);
+                        read_state = 4;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    const uint16_t _frame_size;
+    const std::chrono::nanoseconds _period;
+    const bool _yield;
+    std::vector<uint8_t> _frame_buffer;
+    uint8_t _read = 0;
+    uint8_t _write = 1;
+    std::array<uint8_t, 8> _group_end = {1, 1, 1, 1, 1, 1, 1, 1};
+    uint8_t _ready = 1;
+    uint8_t _first = 0;
+    uint8_t _buffer_depth = 7;
+    bool _delta = false;
+    std::vector<uint8_t> _delta_header;
+    uint16_t _transfer_size;
+    uint16_t _delta_offset = 0;
+    uint16_t _echo_checksum = 0;
+    std::array<std::atomic<uint32_t>, size / sizeof(uint32_t)>* _registers;
+    std::atomic<uint64_t> _frames;
+    std::atomic<uint64_t> _handshakes;
+    std::atomic<uint64_t> _timeouts;
+    std::atomic<uint64_t> _presented;
+    std::atomic<uint64_t> _looped;
+    std::atomic<uint64_t> _transfer_duration;
+    std::atomic<uint64_t> _resets;
+    std::atomic<int64_t> _unplugged_until;
+    std::mutex _presentations_mutex;
+    bool _record_presentations = false;
+    std::vector<std::chrono::steady_clock::time_point> _presentations;
+    std::atomic_bool _running;
+    std::thread _loop;
+};
+
+/// simulated_gpio is a led_panel register backend connected to a simulated_arduino.
+/// Writes to the set and clear registers update the level register, as they would on the hardware.
+class simulated_gpio {
+    public:
+    simulated_gpio(simulated_arduino& arduino) : _registers(arduino.registers()), _yield(arduino.yield()) {}
+
+    /// write stores a value in the given register.
+    void write(uint8_t offset, uint32_t value) {
+        switch (offset) {
+            case simulated_arduino::set_offset:
+                _registers[simulated_arduino::level_offset].fetch_or(value);
+                break;
+            case simulated_arduino::clear_offset:
+                _registers[simulated_arduino::level_offset].fetch_and(~value);
+                break;
+            default:
+                _registers[offset].store(value);
+                break;
+        }
+    }
+
+    /// read loads the value of the given register.
+    uint32_t read(uint8_t offset) {
+        if (_yield) {
+            std::this_thread::yield();
+        }
+        return _registers[offset].load();
+    }
+
+    protected:
+    std::atomic<uint32_t>* _registers;
+    bool _yield;
+};
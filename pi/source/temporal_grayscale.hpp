@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// maximum_planes is the largest number of bit-planes per group.
+/// The firmware's frame buffer has 8 slots: the displayed group and the group being received must fit in it.
+constexpr uint8_t maximum_planes = 4;
+
+/// plane_brightness returns the brightness of a bit-plane, weighted by its significance.
+/// The most significant plane uses the full brightness, each less significant plane half the brightness of the next.
+constexpr uint8_t plane_brightness(uint8_t brightness, uint8_t plane, uint8_t planes) {
+    return static_cast<uint8_t>(((brightness << (plane + 1)) + (1 << (planes - 1))) >> planes);
+}
+
+/// temporal_grayscale displays grayscale frames on a led_panel with bit-plane modulation.
+/// Pixel levels are quantized to planes bits (2^planes levels). Each bit is sent as a packed plane, with a brightness
+/// proportional to its weight (see plane_brightness), and the firmware displays the planes of a group one period
+/// (9.984 ms) each, in a loop, until the next group is complete. Hence a still image is transmitted once, and a
+/// changing image requires one plane transfer per display period. Grayscale frames are refreshed at 100.2 / planes Hz.
+/// A group identical to the previous one is not transmitted.
+template <typename Panel>
+class temporal_grayscale {
+    public:
+    temporal_grayscale(Panel& panel, uint8_t planes = 3) :
+        _panel(panel),
+        _planes(planes),
+        _packed(planes * static_cast<std::size_t>(panel.frame_size())),
+        _previous_brightness(0),
+        _previous_valid(false),
+        _sent(0),
+        _skipped(0),
+        _transfer_duration(0) {
+        if (_planes == 0 || _planes > maximum_planes) {
+            throw std::logic_error(
+                "the number of planes must be in the range [1, " + std::to_string(maximum_planes) + "]");
+        }
+    }
+    temporal_grayscale(const temporal_grayscale&) = delete;
+    temporal_grayscale(temporal_grayscale&& other) = delete;
+    temporal_grayscale& operator=(const temporal_grayscale&) = delete;
+    temporal_grayscale& operator=(temporal_grayscale&& other) = delete;
+    virtual ~temporal_grayscale() {}
+
+    /// send converts a grayscale frame to planes and transmits them.
+    /// grayscale must point to width * height * 512 bytes (row major, one byte per pixel).
+    void send(uint8_t brightness, const uint8_t* grayscale) {
+        _previous_packed.swap(_packed);
+        _packed.resize(_previous_packed.size());
+        const auto frame_size = _panel.frame_size();
+        for (uint16_t index = 0; index < frame_size; ++index) {
+            std::array<uint8_t, maximum_planes> bytes{};
+            for (uint8_t bit = 0; bit < 8; ++bit) {
+                const uint8_t level = grayscale[index * 8 + bit] >> (8 - _planes);
+                for (uint8_t plane = 0; plane < _planes; ++plane) {
+                    bytes[plane] |= static_cast<uint8_t>(((level >> plane) & 1) << (7 - bit));
+                }
+            }
+            for (uint8_t plane = 0; plane < _planes; ++plane) {
+                _packed[plane * static_cast<std::size_t>(frame_size) + index] = bytes[plane];
+            }
+        }
+        if (_previous_valid && brightness == _previous_brightness && _packed == _previous_packed) {
+            ++_skipped;
+            return;
+        }
+        std::chrono::nanoseconds transfer_duration(0);
+        for (uint8_t plane = 0; plane < _planes; ++plane) {
+            _panel.send_plane(
+                plane_brightness(brightness, plane, _planes),
+                _packed.data() + plane * static_cast<std::size_t>(frame_size),
+                plane == _planes - 1);
+            transfer_duration += _panel.transfer_duration();
+        }
+        _previous_brightness = brightness;
+        _previous_valid = true;
+        _transfer_duration = transfer_duration / _planes;
+        ++_sent;
+    }
+
+    /// planes returns the number of bit-planes per group.
+    uint8_t planes() const {
+        return _planes;
+    }
+
+    /// sent returns the number of transmitted groups.
+    uint64_t sent() const {
+        return _sent;
+    }
+
+    /// skipped returns the number of groups identical to the previous one, which were not transmitted.
+    uint64_t skipped() const {
+        return _skipped;
+    }
+
+    /// plane_transfer_duration returns the average transfer duration of a plane, for the last transmitted group.
+    std::chrono::nanoseconds plane_transfer_duration() const {
+        return _transfer_duration;
+    }
+
+    /// budget_usage returns the ratio of plane_transfer_duration and the display period.
+    /// A changing image can be displayed without dropping planes if the ratio is smaller than 1.
+    double budget_usage() const {
+        return std::chrono::duration<double>(_transfer_duration).count()
+               / std::chrono::duration<double>(display_period).count();
+    }
+
+    protected:
+    Panel& _panel;
+    const uint8_t _planes;
+    std::vector<uint8_t> _packed;
+    std::vector<uint8_t> _previous_packed;
+    uint8_t _previous_brightness;
+    bool _previous_valid;
+    uint64_t _sent;
+    uint64_t _skipped;
+    std::chrono::nanoseconds _transfer_duration;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/// waveform_cache_statistics counts the lookups of a waveform_cache.
+struct waveform_cache_statistics {
+    /// hits is the number of frames replayed from the cache.
+    uint64_t hits;
+
+    /// misses is the number of frames compiled and inserted in the cache.
+    uint64_t misses;
+
+    /// evictions is the number of least recently used waveforms removed to make room for new ones.
+    uint64_t evictions;
+
+    /// entries is the number of cached waveforms.
+    std::size_t entries;
+
+    /// memory is the number of bytes allocated for the cached waveforms and their contents.
+    std::size_t memory;
+};
+
+/// waveform_cache stores compiled frames (waveforms) in least recently used order.
+/// A waveform has a set word and a clear word per transmitted byte (brightness, pixels in wire order and trailer),
+/// hence replaying it only requires register stores and acknowledge polling. Waveforms are keyed by a hash of the
+/// frame content, and the content is kept to resolve collisions.
+/// The functions must be called by a single thread.
+class waveform_cache {
+    public:
+    waveform_cache(std::size_t capacity) : _capacity(capacity), _hits(0), _misses(0), _evictions(0) {
+        if (_capacity == 0) {
+            throw std::logic_error("the waveform cache capacity must be larger than 0");
+        }
+        _index.reserve(_capacity);
+    }
+    waveform_cache(const waveform_cache&) = delete;
+    waveform_cache(waveform_cache&& other) = delete;
+    waveform_cache& operator=(const waveform_cache&) = delete;
+    waveform_cache& operator=(waveform_cache&& other) = delete;
+    virtual ~waveform_cache() {}
+
+    /// hash calculates the key of a frame.
+    /// The pixels are read as 64 bits words in four independent lanes (multiply and xor-shift mixing), which are
+    /// combined at the end, hence a 16 panels frame takes 32 mixing rounds instead of 1024 byte-serial steps.
+    static uint64_t hash(uint8_t brightness, const uint8_t* pixels, uint16_t size, uint8_t trailer) {
+        std::array<uint64_t, 4> lanes = {
+            0xcbf29ce484222325u ^ brightness,
+            0x84222325cbf29ce4u ^ trailer,
+            0x9e3779b97f4a7c15u ^ size,
+            0xc2b2ae3d27d4eb4fu};
+        const auto mix = [](uint64_t value, uint64_t word) {
+            value = (value ^ word) * 0x9e3779b97f4a7c15u;
+            return value ^ (value >> 32);
+        };
+        uint16_t index = 0;
+        for (; index + 32 <= size; index += 32) {
+            for (uint8_t lane = 0; lane < 4; ++lane) {
+                uint64_t word;
+                std::memcpy(&word, pixels + index + 8 * lane, sizeof(word));
+                lanes[lane] = mix(lanes[lane], word);
+            }
+        }
+        for (; index < size; ++index) {
+            lanes[0] = mix(lanes[0], pixels[index]);
+        }
+        auto result = lanes[0];
+        for (uint8_t lane = 1; lane < 4; ++lane) {
+            result = mix(result, lanes[lane]);
+        }
+        return result;
+    }
+
+    /// find returns the waveform of the given frame, or nullptr if it is not cached.
+    /// A cached waveform becomes the most recently used one.
+    const std::vector<uint32_t>*
+    find(uint64_t key, uint8_t brightness, const uint8_t* pixels, uint16_t size, uint8_t trailer) {
+        const auto found = _index.find(key);
+        if (found == _index.end() || !found->second->matches(brightness, pixels, size, trailer)) {
+            return nullptr;
+        }
+        _entries.splice(_entries.begin(), _entries, found->second);
+        ++_hits;
+        return &found->second->words;
+    }
+
+    /// insert adds a frame to the cache and returns its waveform, which must be filled by the caller.
+    /// The least recently used waveform is evicted if the cache is full, and its memory is reused.
+    std::vector<uint32_t>&
+    insert(uint64_t key, uint8_t brightness, const uint8_t* pixels, uint16_t size, uint8_t trailer) {
+        ++_misses;
+        const auto found = _index.find(key);
+        if (found != _index.end()) {
+            // hash collision with a different content, the previous waveform is replaced
+            _entries.splice(_entries.begin(), _entries, found->second);
+        } else if (_entries.size() < _capacity) {
+            _entries.emplace_front();
+            _index.emplace(key, _entries.begin());
+        } else {
+            ++_evictions;
+            _index.erase(_entries.back().key);
+            _entries.splice(_entries.begin(), _entries, std::prev(_entries.end()));
+            _index.emplace(key, _entries.begin());
+        }
+        auto& entry = _entries.front();
+        entry.key = key;
+        entry.content.resize(size + 2u);
+        entry.content[0] = brightness;
+        std::copy(pixels, pixels + size, std::next(entry.content.begin()));
+        entry.content.back() = trailer;
+        entry.words.clear();
+        return entry.words;
+    }
+
+    /// statistics returns the lookup counters and the memory usage.
+    waveform_cache_statistics statistics() const {
+        std::size_t memory = 0;
+        for (const auto& entry : _entries) {
+            memory += sizeof(entry) + entry.content.capacity() + entry.words.capacity() * sizeof(uint32_t);
+        }
+        return {_hits, _misses, _evictions, _entries.size(), memory};
+    }
+
+    protected:
+    /// entry is a cached waveform.
+    struct entry {
+        uint64_t key;
+        std::vector<uint8_t> content;
+        std::vector<uint32_t> words;
+
+        /// matches returns true if the entry was compiled from the given frame.
+        bool matches(uint8_t brightness, const uint8_t* pixels, uint16_t size, uint8_t trailer) const {
+            return content.size() == size + 2u && content[0] == brightness && content.back() == trailer
+                   && std::memcmp(pixels, content.data() + 1, size) == 0;
+        }
+    };
+
+    const std::size_t _capacity;
+    std::list<entry> _entries;
+    std::unordered_map<uint64_t, std::list<entry>::iterator> _index;
+    uint64_t _hits;
+    uint64_t _misses;
+    uint64_t _evictions;
+};